@@ -14,6 +14,8 @@
 #include <thread>
 #include <windows.h>
 #include "ScriptJit.h"
+#include "ScriptLowering.h"
+#include "ScriptBytecode.h"
 
 
 void startup() {
@@ -47,6 +49,7 @@ int main() {
 	ScriptContext ctx{};
 	LoadBasic(ctx);
 	LoadCMath(ctx);
+	LoadVector(ctx);
 	//{
 	//	ir::Emitter emit{};
 	//	emit.EmitOp(ir::OP_PushI4, 1);
@@ -121,7 +124,7 @@ int main() {
 					clr = PredefinedColor::Ctrlflow;
 					break;
 				}
-				if (ctx.InternalFunctions.find(std::string(tok.lexeme)) != ctx.InternalFunctions.end()) {
+				if (ctx.InternalFunctions.contains(std::string(tok.lexeme)) || ctx.NativeFunctions.contains(std::string(tok.lexeme))) {
 					clr = PredefinedColor::Function;
 					break;
 				}
@@ -129,7 +132,7 @@ int main() {
 					clr = PredefinedColor::Keyword;
 					break;
 				}
-				if (ctx.GlobalVars.find(std::string(tok.lexeme)) != ctx.GlobalVars.end()) {
+				if (ctx.GlobalSlots.find(std::string(tok.lexeme)) != ctx.GlobalSlots.end()) {
 					clr = PredefinedColor::GlobalVariable;
 					break;
 				}
@@ -378,6 +381,7 @@ int main() {
 							//	std::cout << "\u001b[38;2;255;40;40m" << ex.what() << "\u001b[38;2;255;255;255m\n";
 							//	em.Bytes.clear();
 							//}
+							ir::LowerToRegisters(em);
 							if (!em.Bytes.empty()) {
 								ir::Interpreter ip(em.Bytes, { em.Strings.begin(), em.Strings.end() });
 								try {
@@ -392,13 +396,16 @@ int main() {
 								}
 								catch (std::exception& ex) {
 									std::cout << "\u001b[38;2;255;40;40m" << ex.what() << "\u001b[38;2;255;255;255m\n"
-											  << "在 解释器 PC -> " << std::hex << ip.GetPC() << std::dec << "\n";
+											  << "在 解释器 PC -> " << std::hex << ip.GetPC() << std::dec
+											  << " (第 " << ir::LineAt(em.Lines, ip.GetPC()) << " 行)\n";
 								}
 							}
 						}
 						if (exp != 0)
 							delete exp;
 						ctx.gc.Collect();
+						if (ctx.gc.Stats.LastFreed != 0)
+							std::cerr << "Erased " << ctx.gc.Stats.LastFreed << " objects. (" << ctx.gc.Stats.LastPause << "ms)\n";
 						std::cin.get();
 						std::cin.clear();
 					}
@@ -17,20 +17,30 @@ namespace AST {
 		virtual bool IsConst(ScriptContext& ctx) {
 			return false;
 		}
+		/// <summary>
+		/// 作为语句发射，同时记录行号
+		/// </summary>
+		void EmitStatement(ir::Emitter& em) {
+			if (Line != 0)
+				em.MarkLine(Line);
+			Emit(em);
+		}
+		// 语句开始的行，表达式中的子节点为 0
+		unsigned int Line = 0;
 	};
 	class Program {
 	public:
 		virtual ~Program() {}
 		void Emit(ir::Emitter& e) {
-			auto init_command = e.EmitOpI1(ir::Opcode::OP_PushN, 0); // 初始化栈
+			auto init_command = e.EmitOp(ir::Opcode::OP_PushNI4, 0); // 初始化栈
 
 
 			// 插入所有程序内的语句
 			for (auto stat : statements_) {
-				stat->Emit(e);
+				stat->EmitStatement(e);
 			}
 
-			init_command.GetOperand() = static_cast<unsigned char>(e.LocalVariables.size()); // 由于已经插入了所有命令，现在可以获取本地变量的数量，并正确初始化栈
+			init_command.GetOperand() = static_cast<int>(e.LocalVariables.size()); // 由于已经插入了所有命令，现在可以获取本地变量的数量，并正确初始化栈
 
 			e.EmitOp(ir::Opcode::OP_Brk); // 终止程序运行，如果执行到末尾
 		}
@@ -62,26 +72,20 @@ namespace AST {
 			auto beg = em.Bytes.size();							 // 记录 Lambda 函数体开始
 			auto jump_across = em.EmitOp(ir::Opcode::OP_Jmp, 0); // 跳过 Lambda 函数体
 
-			// 隔离 Emitter
-			ir::Emitter em2{};
-			em2.ctx = em.ctx;
-			em2.Arguments = Params;
-			em2.Strings = em.Strings;
-			em2.Bytes = em.Bytes;
+			// 隔离函数的编译状态(参数、本地变量)，指令与字符串直接追加到 em 中
+			auto outer = em.EnterFunction(Params);
 
-			auto func_start = em.Bytes.size();						   // 记录函数的开始
-			auto init_command = em2.EmitOpI1(ir::Opcode::OP_PushN, 0); // 初始化栈
+			auto func_start = em.Bytes.size();						  // 记录函数的开始
+			auto init_command = em.EmitOp(ir::Opcode::OP_PushNI4, 0); // 初始化栈
 
 			// 按序插入所有语句
 			for (auto exp : Statements) {
-				exp->Emit(em2);
+				exp->EmitStatement(em);
 			}
 
-			// 拷贝新插入的指令
-			em.Bytes = em2.Bytes;
-			em.Strings = em2.Strings;
+			init_command.GetOperand() = static_cast<int>(em.LocalVariables.size()); // 获取新的栈的本地变量数量，使其正确初始化
+			em.LeaveFunction(outer);
 
-			init_command.GetOperand() = static_cast<unsigned char>(em2.LocalVariables.size()); // 获取新的栈的本地变量数量，使其正确初始化
 			em.EmitOp(ir::Opcode::OP_RetNull);												   // 以防 CtrlFlow 中有路径没有返回，插入额外的返回指令，抛弃任何可能的数据
 			auto end = em.Bytes.size();														   // Lambda 函数的结尾
 			jump_across.GetOperand() = (int)(end - beg) - 5;								   // 计算需要跳过的距离，并减去 Jmp imm4 指令的长度(5)
@@ -138,16 +142,14 @@ namespace AST {
 			ctx.SetGlobalVar(VariantName, v);
 		}
 		void Emit(ir::Emitter& em) override {
-			if (em.ctx != nullptr)
-				em.ctx->GlobalVars[VariantName];				  // 保留为全局变量，使后续 Emit 流程 插入正确 Scope 的指令
-			em.EmitOp(ir::Opcode::OP_PushGlobalVar, VariantName); // 插入读取变量的指令
+			em.EmitOpPushGlobal(VariantName); // 插入读取变量的指令(同时保留为全局变量，使后续 Emit 流程 插入正确 Scope 的指令)
 		}
 		void EmitSet(ir::Emitter& em, Expression* tgt) override {
 			if (em.ctx != nullptr)
-				em.ctx->GlobalVars[VariantName]; // 保留为全局变量，使后续 Emit 流程 插入正确 Scope 的指令
+				em.ctx->GlobalSlot(VariantName); // 保留为全局变量，使后续 Emit 流程 插入正确 Scope 的指令
 			if (tgt != 0)
-				tgt->Emit(em);									   // 插入目标语句，如果可能
-			em.EmitOp(ir::Opcode::OP_StoreGlobalVar, VariantName); // 插入存储变量的指令
+				tgt->Emit(em);					  // 插入目标语句，如果可能
+			em.EmitOpStoreGlobal(VariantName); // 插入存储变量的指令
 		}
 	};
 	class StringExpression : public Expression {
@@ -158,7 +160,7 @@ namespace AST {
 		}
 		// 通过 Expression 继承
 		Variant Eval(ScriptContext& ctx) override {
-			return { ctx.gc, str.data() };
+			return ctx.Intern(str);
 		}
 
 		StringExpression(const std::string& str)
@@ -283,6 +285,9 @@ namespace AST {
 		BinaryExpression(Expression* leftExpression, BinOp op, Expression* rightExpression)
 			: leftExpression_(leftExpression), op(op), rightExpression_(rightExpression) {}
 		bool IsConst(ScriptContext& ctx) override {
+			// 区间会创建对象，不能折叠为常量
+			if (op == BinOp::Range)
+				return false;
 			return leftExpression_->IsConst(ctx) && rightExpression_->IsConst(ctx);
 		}
 		~BinaryExpression() {
@@ -630,35 +635,8 @@ namespace AST {
 			case AST::BinOp::Range: {
 				auto lft = leftExpression_->Eval(ctx);
 				auto rht = rightExpression_->Eval(ctx);
-				if (lft.Type == Variant::DataType::Long || rht.Type == Variant::DataType::Long) {
-					Variant v{};
-					v.Type = Variant::DataType::Object;
-					auto arr = new ScriptArray(ctx.gc);
-					if (rht.Long < lft.Long)
-						std::swap(rht.Long, lft.Long);
-					arr->Variants.resize(rht.Long - lft.Long);
-					size_t p = 0;
-					for (long long i = lft.Long; i < rht.Long; i++) {
-						arr->Set(p++, i);
-					}
-					v.Object = arr;
-					return v;
-				}
-				if (lft.Type == Variant::DataType::Int || rht.Type == Variant::DataType::Int) {
-					Variant v{};
-					v.Type = Variant::DataType::Object;
-					auto arr = new ScriptArray(ctx.gc);
-					if (rht.Int < lft.Int)
-						std::swap(rht.Int, lft.Int);
-					arr->Variants.resize(rht.Int - lft.Int);
-					size_t p = 0;
-					for (int i = lft.Int; i < rht.Long; i++) {
-						arr->Set(p++, i);
-					}
-					v.Object = arr;
-					return v;
-				}
-				throw std::exception("Cannot promote a fit type.");
+				// 区间只保存两端，不生成元素
+				return ScriptRange::Create(ctx.gc, lft, rht);
 			} break;
 			default:
 				throw std::exception("Invalid operation.");
@@ -781,7 +759,8 @@ namespace AST {
 				em.EmitOp(ir::Opcode::OP_GetIndex);
 				break;
 			case AST::BinOp::Range:
-				throw std::runtime_error("Range haven't been suppported.");
+				em.EmitOp(ir::Opcode::OP_Range);
+				break;
 			default:
 				throw std::runtime_error("op haven't been supported.");
 				break;
@@ -848,6 +827,9 @@ namespace AST {
 			if (left.Type == Variant::DataType::InternMethod) {
 				return left.InternMethod(ctx, vars);
 			}
+			if (left.Type == Variant::DataType::NativeMethod) {
+				return left.Native->Call(ctx, vars.data(), vars.size());
+			}
 			throw std::exception("Left is not Callable.");
 			return {};
 		}
@@ -987,9 +969,12 @@ namespace AST {
 			: expressions(expression) {}
 
 		void Emit(ir::Emitter& em) override {
+			// 块中 let 声明的变量只在块内可见
+			em.PushScope();
 			for (auto exp : expressions) {
-				exp->Emit(em);
+				exp->EmitStatement(em);
 			}
+			em.PopScope();
 		}
 		std::vector<Statement*> expressions;
 	};
@@ -1025,12 +1010,12 @@ namespace AST {
 			auto beg = em.Bytes.size();
 			// je [elseBranch]
 			em.EmitOp(ir::Opcode::OP_Jnz, 0);
-			thenStatement_->Emit(em);
+			thenStatement_->EmitStatement(em);
 			auto el = em.Bytes.size();
 			if (elseStatement_ != 0) {
 				// jmp end
 				em.EmitOp(ir::Opcode::OP_Jmp, 0);
-				elseStatement_->Emit(em);
+				elseStatement_->EmitStatement(em);
 				auto ed = em.Bytes.size();
 				em.Modify(em.Bytes.begin() + el + 1, (int)(ed - el - 5));
 				em.Modify(em.Bytes.begin() + beg + 1, (int)(el - beg));
@@ -1056,7 +1041,7 @@ namespace AST {
 			auto branch = em.Bytes.size();
 			em.EmitOp(ir::Opcode::OP_Jnz, 0);
 			auto binds = em.LateBinds;
-			Statements->Emit(em);
+			Statements->EmitStatement(em);
 			auto end = em.Bytes.size();
 			em.EmitOp(ir::Opcode::OP_Jmp, -(int)(end - beg) - 5);
 			auto end2 = em.Bytes.size();
@@ -1080,7 +1065,7 @@ namespace AST {
 			em.EmitOp(ir::Opcode::OP_Jnz, 0);
 			auto binds = em.LateBinds;
 			if (bodyStatement_ != 0)
-				bodyStatement_->Emit(em);
+				bodyStatement_->EmitStatement(em);
 			stepExpression_->Emit(em);
 			em.EmitOp(ir::Opcode::OP_Pop);
 			auto end = em.Bytes.size();
@@ -1127,6 +1112,115 @@ namespace AST {
 		std::string varname;
 		Expression* rangeExpression;
 		Statement* bodyStatement_;
+		void Emit(ir::Emitter& em) override {
+			auto range = dynamic_cast<BinaryExpression*>(rangeExpression);
+			if (range != nullptr && range->op == BinOp::Range)
+				EmitCountedLoop(em, range);
+			else
+				EmitIteration(em);
+		}
+
+	private:
+		/// <summary>
+		/// 一般的 foreach，使用迭代协议：
+		/// src = BeginFor(expr); i = 0; while(MoveNext(src, i) 得到 x) { body; i++; }
+		/// 数组、数值数组、区间按下标取元素，对象遍历属性名
+		/// </summary>
+		void EmitIteration(ir::Emitter& em) {
+			auto src = em.NewTemporary();
+			auto index = em.NewTemporary();
+			rangeExpression->Emit(em);
+			em.EmitOp(ir::Opcode::OP_BeginFor);
+			em.EmitOpStoreVar(src);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			em.EmitOp(ir::Opcode::OP_PushI4_0);
+			em.EmitOpStoreVar(index);
+			em.EmitOp(ir::Opcode::OP_Pop);
+
+			auto beg = em.Bytes.size();
+			em.EmitOpPushVar(src);
+			em.EmitOpPushVar(index);
+			auto next = em.Bytes.size();
+			em.EmitOp(ir::Opcode::OP_MoveNext, 0);
+			em.EmitOpStoreVar(varname);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			auto binds = em.LateBinds;
+			if (bodyStatement_ != 0)
+				bodyStatement_->EmitStatement(em);
+			auto cont = em.Bytes.size();
+			em.EmitOpPushVar(index);
+			em.EmitOp(ir::Opcode::OP_Inc);
+			em.EmitOpStoreVar(index);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			auto jmp = em.Bytes.size();
+			em.EmitOp(ir::Opcode::OP_Jmp, -(int)(jmp - beg) - 5);
+			auto exit = em.Bytes.size();
+			em.Modify(em.Bytes.begin() + next + 1, (int)(exit - next) - 5);
+			em.EvalLateBinds(exit, cont);
+			em.LateBinds = binds;
+		}
+		/// <summary>
+		/// foreach(x : a..b) 直接展开为计数循环，不创建区间对象：
+		/// i = a; end = b; 若 end < i 则交换; while(i < end) { x = i; body; i++; }
+		/// </summary>
+		void EmitCountedLoop(ir::Emitter& em, BinaryExpression* range) {
+			auto counter = em.NewTemporary();
+			auto end = em.NewTemporary();
+			range->leftExpression_->Emit(em);
+			em.EmitOpStoreVar(counter);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			range->rightExpression_->Emit(em);
+			em.EmitOpStoreVar(end);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			// 两端不都是整数常量时，进入循环前用 OP_Range 检查类型(与 a..b 报同样的错误)，循环本身不使用区间对象
+			auto isInt = [](Expression* e) {
+				auto num = dynamic_cast<NumberExpression*>(e);
+				return num != nullptr && (num->var.Type == Variant::DataType::Int || num->var.Type == Variant::DataType::Long);
+			};
+			if (!isInt(range->leftExpression_) || !isInt(range->rightExpression_)) {
+				em.EmitOpPushVar(counter);
+				em.EmitOpPushVar(end);
+				em.EmitOp(ir::Opcode::OP_Range);
+				em.EmitOp(ir::Opcode::OP_Pop);
+			}
+			// 与 a..b 相同，b 小于 a 时交换两端
+			em.EmitOpPushVar(end);
+			em.EmitOpPushVar(counter);
+			em.EmitOp(ir::Opcode::OP_Lt);
+			auto ordered = em.Bytes.size();
+			em.EmitOp(ir::Opcode::OP_Jnz, 0);
+			em.EmitOpPushVar(counter);
+			em.EmitOpPushVar(end);
+			em.EmitOpStoreVar(counter);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			em.EmitOpStoreVar(end);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			em.Modify(em.Bytes.begin() + ordered + 1, (int)(em.Bytes.size() - ordered) - 5);
+
+			auto beg = em.Bytes.size();
+			em.EmitOpPushVar(counter);
+			em.EmitOpPushVar(end);
+			em.EmitOp(ir::Opcode::OP_Lt);
+			auto branch = em.Bytes.size();
+			em.EmitOp(ir::Opcode::OP_Jnz, 0);
+			em.EmitOpPushVar(counter);
+			em.EmitOpStoreVar(varname);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			auto binds = em.LateBinds;
+			if (bodyStatement_ != 0)
+				bodyStatement_->EmitStatement(em);
+			auto cont = em.Bytes.size();
+			em.EmitOpPushVar(counter);
+			em.EmitOp(ir::Opcode::OP_Inc);
+			em.EmitOpStoreVar(counter);
+			em.EmitOp(ir::Opcode::OP_Pop);
+			auto jmp = em.Bytes.size();
+			em.EmitOp(ir::Opcode::OP_Jmp, -(int)(jmp - beg) - 5);
+			auto exit = em.Bytes.size();
+			em.Modify(em.Bytes.begin() + branch + 1, (int)(exit - branch) - 5);
+			em.EvalLateBinds(exit, cont);
+			em.LateBinds = binds;
+		}
 	};
 	class AssignmentStatement : public Statement {
 	public:
@@ -1139,19 +1233,20 @@ namespace AST {
 			for (auto& [name, init] : initials) {
 				if (scope == Scope::Global) {
 					if (em.ctx != nullptr)
-						em.ctx->GlobalVars[name];
+						em.ctx->GlobalSlot(name);
 					if (init != 0)
 						init->Emit(em);
 					else
 						em.EmitOp(ir::Opcode::OP_PushNull);
-					em.EmitOp(ir::Opcode::OP_StoreGlobalVar, name);
+					em.EmitOpStoreGlobal(name);
 				}
 				else {
 					if (init != 0)
 						init->Emit(em);
 					else
 						em.EmitOp(ir::Opcode::OP_PushNull);
-					em.EmitOpStoreVar(name);
+					// 初始值中的同名变量仍指向外层，之后才声明
+					em.EmitOpStoreLocal(em.DeclareLocal(name));
 				}
 			}
 			em.EmitOpI1(ir::Opcode::OP_Popn, static_cast<unsigned char>(initials.size()));
@@ -1184,7 +1279,10 @@ private:
 	size_t position_;
 
 	AST::Statement* parseStatement() {
+		auto line = position_ < tokens_.size() ? tokens_[position_].line : 0;
 		auto stat = parseStatement_In();
+		if (stat != nullptr)
+			stat->Line = line;
 		match(Lexer::TokenType::Delimiter, ";");
 		return stat;
 	}
@@ -1468,7 +1566,8 @@ private:
 		case AST::BinOp::Member:
 			return 200;
 		case AST::BinOp::Range:
-			return 300;
+			// 低于算术运算，0..n+1 即 0..(n+1)
+			return 50;
 		default:
 			return 1;
 		}
@@ -1522,7 +1621,7 @@ private:
 		if (sv == "^") {
 			return AST::BinOp::Xor;
 		}
-		if (sv == "@") {
+		if (sv == "@" || sv == "..") {
 			return AST::BinOp::Range;
 		}
 		if (sv == "+=") {
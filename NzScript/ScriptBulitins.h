@@ -2,87 +2,112 @@
 #include "ScriptContext.h"
 #include <cmath>
 #include <iostream>
+/// <summary>
+/// 创建数值数组：参数为长度(元素初始化为 0)，或是要转换的普通数组
+/// </summary>
+template <class T>
+Variant MakeTypedArray(ScriptContext& ctx, const Variant& src) {
+	T* arr;
+	if (src.Type == Variant::DataType::Object && src.Object->GetKind() == (unsigned char)ObjectKind::Array) {
+		auto from = (ScriptArray*)src.Object;
+		arr = new (ctx.gc) T(ctx.gc, from->Size());
+		for (size_t i = 0; i < from->Size(); i++)
+			arr->Set(i, from->Variants[i]);
+	}
+	else {
+		auto size = script_cast<long long>(src);
+		if (size < 0)
+			throw std::exception("Invalid array length.");
+		arr = new (ctx.gc) T(ctx.gc, (size_t)size);
+	}
+	Variant v{};
+	v.Type = Variant::DataType::Object;
+	v.Object = arr;
+	return v;
+}
 void LoadBasic(ScriptContext& ctx) {
-	ctx.InternalFunctions["print"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
+	ctx.NativeFunctions["print"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		for (auto var : vars) {
 			std::cout << var.ToString() << " ";
 		}
 		std::cout << "\n";
 		return {};
-	};
-	ctx.InternalFunctions["intern"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: intern(obj)");
-		}
+	} };
+	ctx.NativeFunctions["intern"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		v.Type = Variant::DataType::Long;
 		return v;
-	};
-	ctx.InternalFunctions["hex"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: hex(obj)");
-		}
+	}, 1, 1, "Usage: intern(obj)" };
+	ctx.NativeFunctions["hex"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		char chr[32];
-		_ui64toa_s(vars[0].Long, chr, 32, 16);
+		_ui64toa_s(script_cast<long long>(vars[0]), chr, 32, 16);
 		return { ctx.gc, chr };
-	};
-	ctx.InternalFunctions["typeof"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: typeof(x)");
-		}
+	}, 1, 1, "Usage: hex(obj)" };
+	ctx.NativeFunctions["typeof"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		return (int)v.Type;
-	};
-	ctx.InternalFunctions["object"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
+	}, 1, 1, "Usage: typeof(x)" };
+	ctx.NativeFunctions["object"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		Variant v2{};
 		v2.Type = Variant::DataType::Object;
-		v2.Object = new ScriptObject(ctx.gc);
+		v2.Object = new (ctx.gc) ScriptObject(ctx.gc);
 		return v2;
-	};
-	ctx.InternalFunctions["collect"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 0) {
-			throw std::exception("Usage: collect()");
-		}
-		ctx.gc.Collect();
+	} };
+	ctx.NativeFunctions["collect"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		// 不带参数时进行全量回收
+		ctx.gc.Collect(vars.empty() || (bool)vars[0]);
 		return {};
-	};
-	ctx.InternalFunctions["objcount"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 0) {
-			throw std::exception("Usage: objcount()");
-		}
+	}, 0, 1, "Usage: collect() or collect(full)" };
+	ctx.NativeFunctions["gcstats"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		auto& st = ctx.gc.Stats;
+		auto obj = new (ctx.gc) ScriptObject(ctx.gc);
+		obj->Set("minor", (long long)st.MinorCollections);
+		obj->Set("major", (long long)st.MajorCollections);
+		obj->Set("pause_ms", st.LastPause);
+		obj->Set("max_pause_ms", st.MaxPause);
+		obj->Set("total_pause_ms", st.TotalPause);
+		obj->Set("freed", (long long)st.TotalFreed);
+		obj->Set("promoted", (long long)st.TotalPromoted);
+		obj->Set("nursery", (long long)ctx.gc.NurseryCount());
+		obj->Set("old", (long long)ctx.gc.OldCount());
+		obj->Set("bytes", (long long)ctx.gc.HeapBytes());
+		obj->Set("budget", (long long)ctx.gc.HeapBudget());
+		Variant v2{};
+		v2.Type = Variant::DataType::Object;
+		v2.Object = obj;
+		return v2;
+	}, 0, 0, "Usage: gcstats()" };
+	ctx.NativeFunctions["objcount"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		return (long long)ctx.gc.ObjectCount();
-	};
-	ctx.InternalFunctions["array"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
+	}, 0, 0, "Usage: objcount()" };
+	ctx.NativeFunctions["array"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		Variant v2{};
 		v2.Type = Variant::DataType::Object;
-		v2.Object = new ScriptArray(ctx.gc);
+		v2.Object = new (ctx.gc) ScriptArray(ctx.gc);
 		return v2;
-	};
-	ctx.InternalFunctions["tostring"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: tostring(obj)");
-		}
+	} };
+	ctx.NativeFunctions["int32array"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		return MakeTypedArray<Int32Array>(ctx, vars[0]);
+	}, 1, 1, "Usage: int32array(size) or int32array(arr)" };
+	ctx.NativeFunctions["int64array"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		return MakeTypedArray<Int64Array>(ctx, vars[0]);
+	}, 1, 1, "Usage: int64array(size) or int64array(arr)" };
+	ctx.NativeFunctions["float64array"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		return MakeTypedArray<Float64Array>(ctx, vars[0]);
+	}, 1, 1, "Usage: float64array(size) or float64array(arr)" };
+	ctx.NativeFunctions["tostring"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		return { ctx.gc, v.ToString().c_str() };
-	};
-	ctx.InternalFunctions["int"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: int(x)");
-		}
+	}, 1, 1, "Usage: tostring(obj)" };
+	ctx.NativeFunctions["int"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		return script_cast<int>(v);
-	};
-	ctx.InternalFunctions["long"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: long(x)");
-		}
+	}, 1, 1, "Usage: int(x)" };
+	ctx.NativeFunctions["long"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		return script_cast<long long>(v);
-	};
-	ctx.InternalFunctions["nameof"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
-		if (vars.size() != 1) {
-			throw std::exception("Usage: nameof(x)");
-		}
+	}, 1, 1, "Usage: long(x)" };
+	ctx.NativeFunctions["nameof"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		auto v = vars[0];
 		switch (v.Type) {
 		case Variant::DataType::Double:
@@ -105,16 +130,29 @@ void LoadBasic(ScriptContext& ctx) {
 			}
 			return { ctx.gc, name.c_str() };
 		}
+		case Variant::DataType::NativeMethod: {
+			std::string name = "{CppMethod:Unknown}";
+			for (auto& func : ctx.NativeFunctions) {
+				if (&func.second == v.Native) {
+					name = "{CppMethod:";
+					name += func.first;
+					name += "}";
+					break;
+				}
+			}
+			return { ctx.gc, name.c_str() };
+		}
 		default:
 			break;
 		}
 		return { ctx.gc, "{Unknown}" };
-	};
-	ctx.InternalFunctions["dir"] = [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
+	}, 1, 1, "Usage: nameof(x)" };
+	ctx.NativeFunctions["dir"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
 		if (vars.size() == 0) {
-			auto sa = new ScriptArray(ctx.gc);
-			for (auto var : ctx.GlobalVars) {
-				sa->Add(Variant{ ctx.gc, var.first.c_str() });
+			auto sa = new (ctx.gc) ScriptArray(ctx.gc);
+			for (auto& name : ctx.GlobalNames) {
+				if (!ctx.IsReadOnlyGlobal(name))
+					sa->Add(Variant{ ctx.gc, name.c_str() });
 			}
 			for (auto var : ctx.InternalConstants) {
 				sa->Add(Variant{ ctx.gc, var.first.c_str() });
@@ -122,14 +160,17 @@ void LoadBasic(ScriptContext& ctx) {
 			for (auto var : ctx.InternalFunctions) {
 				sa->Add(Variant{ ctx.gc, var.first.c_str() });
 			}
+			for (auto& var : ctx.NativeFunctions) {
+				sa->Add(Variant{ ctx.gc, var.first.c_str() });
+			}
 			Variant v{};
 			v.Type = Variant::DataType::Object;
 			v.Object = sa;
 			return v;
 		}
-		else if (vars.size() == 1) {
+		else {
 			auto v2 = vars[0];
-			auto sa = new ScriptArray(ctx.gc);
+			auto sa = new (ctx.gc) ScriptArray(ctx.gc);
 			switch (v2.Type) {
 			case Variant::DataType::Double:
 			case Variant::DataType::Float:
@@ -137,11 +178,12 @@ void LoadBasic(ScriptContext& ctx) {
 			case Variant::DataType::Long:
 			case Variant::DataType::String:
 			case Variant::DataType::InternMethod:
+			case Variant::DataType::NativeMethod:
 				break;
 			case Variant::DataType::Object: {
 				if (v2.Object->GetType() == typeid(ScriptObject))
-					for (auto var : ((ScriptObject*)v2.Object)->Fields) {
-						sa->Add(Variant{ ctx.gc, var.first.c_str() });
+					for (auto& name : ((ScriptObject*)v2.Object)->Layout->Names) {
+						sa->Add(Variant{ ctx.gc, name.c_str() });
 					}
 			} break;
 			default:
@@ -152,9 +194,7 @@ void LoadBasic(ScriptContext& ctx) {
 			v.Object = sa;
 			return v;
 		}
-		else {
-			throw std::exception("Usage: dir() or dir(x)");
-		}
-	};
+	}, 0, 1, "Usage: dir() or dir(x)" };
 }
-#include "CMathBulitins.h"
\ No newline at end of file
+#include "CMathBulitins.h"
+#include "VectorBulitins.h"
\ No newline at end of file
@@ -0,0 +1,769 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <vector>
+#include "ScriptIr.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+/*
+字节码文件：
+
+把 Emitter 的输出(通常已经经过 LowerToRegisters)保存下来，之后不再经过词法分析、语法分析与发射，
+载入后直接交给 Interpreter 执行。
+
+布局(小端，整数都是 uint32)：
+	文件头      Magic("NZBC")、Version、节的数量
+	节          Id、Size、Size 字节的数据
+节：
+	Code        指令
+	Strings     常量池：数量，之后每个字符串为 长度 + 内容
+	Globals     代码用到的全局变量的名称，格式同 Strings。写入时槽位按编译时的顺序重新编号为 0..n-1，载入时按名称重新分配
+	Functions   函数入口(OP_PushFuncPtr 的目标)：数量 + PC
+	Lines       行号表：数量 + (PC, Line)
+读取时跳过未知的节。操作码的编号或操作数的含义改变时必须增加 BytecodeVersion。
+文件不可信：读取时每个数量都受节中剩余字节数的限制，并检查所有指令的操作数与栈深度(见 BytecodeReader::Validate)，
+不合法的文件在载入时被拒绝，而不是在运行时越界。
+
+载入不复制指令：BytecodeModule::Code 直接指向文件的数据(可以是 MappedFile 映射的只读内存)，
+交给只读模式的 Interpreter 后，同一份代码可以被任意多个解释器共享。
+只有在 BindGlobals 发现槽位与编译时不同时，才复制一份指令改写。
+*/
+namespace ir {
+	constexpr uint32_t BytecodeMagic = 0x43425A4E; // "NZBC"
+	constexpr uint32_t BytecodeVersion = 1;
+	enum class BytecodeSection : uint32_t {
+		Code = 1,
+		Strings,
+		Globals,
+		Functions,
+		Lines,
+	};
+	/// <summary>
+	/// 只读映射到内存的文件
+	/// </summary>
+	class MappedFile {
+		const char* Base = nullptr;
+		size_t Size = 0;
+#ifdef _WIN32
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+#endif
+
+	public:
+		MappedFile(const std::string& path) {
+#ifdef _WIN32
+			File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER size{};
+			if (File == INVALID_HANDLE_VALUE || !GetFileSizeEx(File, &size))
+				throw std::runtime_error("Cannot open bytecode file.");
+			Size = (size_t)size.QuadPart;
+			// 空文件不能映射
+			if (Size == 0)
+				return;
+			Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (Mapping != nullptr)
+				Base = (const char*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+			if (Base == nullptr)
+				throw std::runtime_error("Cannot map bytecode file.");
+#else
+			int fd = open(path.c_str(), O_RDONLY);
+			struct stat st {};
+			if (fd < 0 || fstat(fd, &st) != 0) {
+				if (fd >= 0)
+					close(fd);
+				throw std::runtime_error("Cannot open bytecode file.");
+			}
+			Size = (size_t)st.st_size;
+			if (Size != 0) {
+				auto p = mmap(nullptr, Size, PROT_READ, MAP_SHARED, fd, 0);
+				Base = p == MAP_FAILED ? nullptr : (const char*)p;
+			}
+			// 映射建立后不再需要文件描述符
+			close(fd);
+			if (Size != 0 && Base == nullptr)
+				throw std::runtime_error("Cannot map bytecode file.");
+#endif
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() {
+#ifdef _WIN32
+			if (Base != nullptr)
+				UnmapViewOfFile(Base);
+			if (Mapping != nullptr)
+				CloseHandle(Mapping);
+			if (File != INVALID_HANDLE_VALUE)
+				CloseHandle(File);
+#else
+			if (Base != nullptr)
+				munmap((void*)Base, Size);
+#endif
+		}
+		std::span<const char> Data() const {
+			return { Base, Size };
+		}
+	};
+	/// <summary>
+	/// 从字节码文件载入的模块
+	/// </summary>
+	struct BytecodeModule {
+		/// <summary>
+		/// 指令。载入时指向文件的数据，BindGlobals 需要改写槽位时指向 Bytes
+		/// </summary>
+		std::span<const char> Code;
+		// 改写过槽位的指令副本，不需要改写时为空
+		std::vector<char> Bytes;
+		// LoadBytecodeFile 读入的文件内容，Code 可能指向这里
+		std::vector<char> Storage;
+		std::vector<std::string> Strings;
+		std::vector<std::string> GlobalNames;
+		std::vector<UImm4> Functions;
+		std::vector<LineEntry> Lines;
+
+		BytecodeModule() = default;
+		// Code 可能指向自身的缓冲区，移动 vector 不改变缓冲区的地址，复制则会
+		BytecodeModule(BytecodeModule&&) = default;
+		BytecodeModule& operator=(BytecodeModule&&) = default;
+		BytecodeModule(const BytecodeModule&) = delete;
+		BytecodeModule& operator=(const BytecodeModule&) = delete;
+		/// <summary>
+		/// 把代码中的全局变量槽位对应到 ctx 中的同名变量(不存在时创建)。
+		/// 按文件中的顺序分配槽位，所以新的上下文中槽位与编译时一致，代码不需要复制；否则复制到 Bytes 后改写
+		/// </summary>
+		void BindGlobals(ScriptContext& ctx) {
+			std::vector<UImm4> slots(GlobalNames.size());
+			bool same = true;
+			for (size_t i = 0; i < GlobalNames.size(); i++) {
+				slots[i] = (UImm4)ctx.GlobalSlot(GlobalNames[i]);
+				same = same && slots[i] == i;
+			}
+			size_t pc = 0;
+			while (pc < Code.size()) {
+				auto op = static_cast<Opcode>(Code[pc]);
+				auto end = pc + 1 + GetOperandSize(op);
+				if (end > Code.size())
+					throw std::runtime_error("Invalid bytecode file.");
+				if (op == OP_PushGlobal || op == OP_StoreGlobal) {
+					UImm4 slot;
+					memcpy(&slot, &Code[pc + 1], sizeof(slot));
+					if (slot >= GlobalNames.size())
+						throw std::runtime_error("Invalid global slot.");
+					if (!same) {
+						if (Bytes.empty()) {
+							Bytes.assign(Code.begin(), Code.end());
+							Code = Bytes;
+						}
+						memcpy(&Bytes[pc + 1], &slots[slot], sizeof(UImm4));
+					}
+				}
+				pc = end;
+			}
+		}
+	};
+	class BytecodeWriter {
+		std::vector<char> Out;
+		size_t SectionStart = 0;
+
+		void U32(uint32_t v) {
+			Out.insert(Out.end(), (char*)&v, (char*)(&v + 1));
+		}
+		void Str(const std::string& s) {
+			U32((uint32_t)s.size());
+			Out.insert(Out.end(), s.begin(), s.end());
+		}
+		void StrList(const std::vector<std::string>& list) {
+			U32((uint32_t)list.size());
+			for (auto& s : list)
+				Str(s);
+		}
+		void BeginSection(BytecodeSection id) {
+			U32((uint32_t)id);
+			SectionStart = Out.size();
+			U32(0);
+		}
+		void EndSection() {
+			auto size = (uint32_t)(Out.size() - SectionStart - sizeof(uint32_t));
+			memcpy(&Out[SectionStart], &size, sizeof(size));
+		}
+		/// <summary>
+		/// 把代码中的全局变量槽位按原顺序重新编号为 0..n-1，返回改写后的代码与对应的名称
+		/// 编译时的上下文可能有很多与这段代码无关的全局变量，只写入用到的
+		/// </summary>
+		static std::vector<char> CompactGlobals(const Emitter& em, std::vector<std::string>& names) {
+			std::vector<char> bytes = em.Bytes;
+			std::vector<UImm4> used;
+			for (size_t pc = 0; pc < bytes.size(); pc += 1 + GetOperandSize(static_cast<Opcode>(bytes[pc]))) {
+				auto op = GetGenericOpcode(static_cast<Opcode>(bytes[pc]));
+				if (op == OP_PushGlobal || op == OP_StoreGlobal) {
+					UImm4 slot;
+					memcpy(&slot, &bytes[pc + 1], sizeof(slot));
+					used.push_back(slot);
+				}
+			}
+			std::sort(used.begin(), used.end());
+			used.erase(std::unique(used.begin(), used.end()), used.end());
+			names.clear();
+			for (auto slot : used) {
+				if (em.ctx == nullptr || slot >= em.ctx->GlobalNames.size())
+					throw std::runtime_error("Invalid global slot.");
+				names.push_back(em.ctx->GlobalNames[slot]);
+			}
+			for (size_t pc = 0; pc < bytes.size(); pc += 1 + GetOperandSize(static_cast<Opcode>(bytes[pc]))) {
+				auto op = GetGenericOpcode(static_cast<Opcode>(bytes[pc]));
+				if (op == OP_PushGlobal || op == OP_StoreGlobal) {
+					UImm4 slot;
+					memcpy(&slot, &bytes[pc + 1], sizeof(slot));
+					slot = (UImm4)(std::lower_bound(used.begin(), used.end(), slot) - used.begin());
+					memcpy(&bytes[pc + 1], &slot, sizeof(slot));
+				}
+			}
+			return bytes;
+		}
+		/// <summary>
+		/// 收集所有函数入口
+		/// </summary>
+		static std::vector<UImm4> FindFunctions(const std::vector<char>& bytes) {
+			std::vector<UImm4> funcs;
+			size_t pc = 0;
+			while (pc < bytes.size()) {
+				auto op = static_cast<Opcode>(bytes[pc]);
+				if (op == OP_PushFuncPtr) {
+					UImm4 entry;
+					memcpy(&entry, &bytes[pc + 1], sizeof(entry));
+					funcs.push_back(entry);
+				}
+				pc += 1 + GetOperandSize(op);
+			}
+			std::sort(funcs.begin(), funcs.end());
+			funcs.erase(std::unique(funcs.begin(), funcs.end()), funcs.end());
+			return funcs;
+		}
+
+	public:
+		std::vector<char> Write(const Emitter& em) {
+			Out.clear();
+			U32(BytecodeMagic);
+			U32(BytecodeVersion);
+			U32(5);
+
+			std::vector<std::string> globals;
+			auto code = CompactGlobals(em, globals);
+			BeginSection(BytecodeSection::Code);
+			Out.insert(Out.end(), code.begin(), code.end());
+			EndSection();
+
+			BeginSection(BytecodeSection::Strings);
+			StrList(em.Strings);
+			EndSection();
+
+			BeginSection(BytecodeSection::Globals);
+			StrList(globals);
+			EndSection();
+
+			BeginSection(BytecodeSection::Functions);
+			auto funcs = FindFunctions(em.Bytes);
+			U32((uint32_t)funcs.size());
+			for (auto f : funcs)
+				U32(f);
+			EndSection();
+
+			BeginSection(BytecodeSection::Lines);
+			U32((uint32_t)em.Lines.size());
+			for (auto& e : em.Lines) {
+				U32(e.PC);
+				U32(e.Line);
+			}
+			EndSection();
+			return std::move(Out);
+		}
+	};
+	class BytecodeReader {
+		std::span<const char> Data;
+		size_t Pos = 0;
+		// 当前节的结尾，读取不能越过它
+		size_t Limit = 0;
+		// 函数体：入口处是 PushNI4(栈帧大小)，紧挨在它之前的 Jmp 跳过整个函数体
+		struct Body {
+			size_t Begin, End, Frame;
+		};
+
+		void Need(size_t n) {
+			if (Limit - Pos < n)
+				throw std::runtime_error("Invalid bytecode file.");
+		}
+		/// <summary>
+		/// 读取元素的数量，每个元素至少占 size 字节，数量不能超过节中剩余的字节所能容纳的
+		/// </summary>
+		uint32_t Count(size_t size) {
+			auto n = U32();
+			if (n > (Limit - Pos) / size)
+				throw std::runtime_error("Invalid bytecode file.");
+			return n;
+		}
+		uint32_t U32() {
+			Need(sizeof(uint32_t));
+			uint32_t v;
+			memcpy(&v, Data.data() + Pos, sizeof(v));
+			Pos += sizeof(v);
+			return v;
+		}
+		std::string Str() {
+			auto n = U32();
+			Need(n);
+			std::string s(Data.data() + Pos, n);
+			Pos += n;
+			return s;
+		}
+		std::vector<std::string> StrList() {
+			// 每个字符串至少有长度字段
+			std::vector<std::string> list(Count(sizeof(uint32_t)));
+			for (auto& s : list)
+				s = Str();
+			return list;
+		}
+
+	public:
+		BytecodeReader(std::span<const char> data) : Data(data), Limit(data.size()) {}
+		BytecodeModule Read() {
+			BytecodeModule mod;
+			if (U32() != BytecodeMagic)
+				throw std::runtime_error("Invalid bytecode file.");
+			if (U32() != BytecodeVersion)
+				throw std::runtime_error("Unsupported bytecode version.");
+			auto sections = U32();
+			for (uint32_t i = 0; i < sections; i++) {
+				auto id = (BytecodeSection)U32();
+				auto size = U32();
+				Need(size);
+				auto end = Pos + size;
+				Limit = end;
+				switch (id) {
+				case BytecodeSection::Code:
+					mod.Code = Data.subspan(Pos, size);
+					break;
+				case BytecodeSection::Strings:
+					mod.Strings = StrList();
+					break;
+				case BytecodeSection::Globals:
+					mod.GlobalNames = StrList();
+					break;
+				case BytecodeSection::Functions:
+					mod.Functions.resize(Count(sizeof(uint32_t)));
+					for (auto& f : mod.Functions)
+						f = U32();
+					break;
+				case BytecodeSection::Lines:
+					mod.Lines.resize(Count(2 * sizeof(uint32_t)));
+					for (auto& e : mod.Lines) {
+						e.PC = U32();
+						e.Line = U32();
+					}
+					break;
+				default:
+					break;
+				}
+				Pos = end;
+				Limit = Data.size();
+			}
+			Validate(mod);
+			return mod;
+		}
+		/// <summary>
+		/// 检查每条指令的操作数，使解释器执行载入的代码时不会越界：
+		/// 字符串下标与全局变量槽位在表的范围内；跳转目标落在同一个函数的指令边界上；
+		/// 函数入口是 Functions 中记录的、以 PushNI4 开始的函数体；本地变量(包括寄存器)的下标小于所在函数的栈帧大小。
+		/// 参数的个数在调用时才知道，由 get_arg 在运行时检查
+		/// </summary>
+		static void Validate(const BytecodeModule& mod) {
+			auto& code = mod.Code;
+			auto fail = []() {
+				throw std::runtime_error("Invalid bytecode file.");
+			};
+			auto operand = [&](size_t pc, size_t offset) {
+				UImm4 v;
+				memcpy(&v, &code[pc + 1 + offset], sizeof(v));
+				return v;
+			};
+			// 指令边界
+			std::vector<size_t> instrs;
+			std::vector<bool> starts(code.size() + 1);
+			size_t pc = 0;
+			while (pc < code.size()) {
+				auto op = static_cast<Opcode>(code[pc]);
+				if (op > OP_RCmpIJnz_I && op != OP_Nop)
+					fail();
+				instrs.push_back(pc);
+				starts[pc] = true;
+				pc += 1 + GetOperandSize(op);
+			}
+			if (pc != code.size() || instrs.empty())
+				fail();
+			auto bodyAt = [&](size_t entry) {
+				if (entry >= code.size() || !starts[entry] || static_cast<Opcode>(code[entry]) != OP_PushNI4)
+					fail();
+				Body body{ entry, code.size(), operand(entry, 0) };
+				if (entry != 0) {
+					auto jmp = entry - 1 - sizeof(Imm4);
+					if (entry < 1 + sizeof(Imm4) || !starts[jmp] || static_cast<Opcode>(code[jmp]) != OP_Jmp)
+						fail();
+					auto end = entry + (int64_t)(Imm4)operand(jmp, 0);
+					if (end <= (int64_t)entry || end > (int64_t)code.size() || !starts[(size_t)end])
+						fail();
+					body.End = (size_t)end;
+				}
+				// 执行不能越过函数体的结尾
+				auto last = *(std::upper_bound(instrs.begin(), instrs.end(), body.End - 1) - 1);
+				switch (GetGenericOpcode(static_cast<Opcode>(code[last]))) {
+				case OP_Ret:
+				case OP_RetNull:
+				case OP_Brk:
+				case OP_Throw:
+				case OP_Jmp:
+					break;
+				default:
+					fail();
+				}
+				return body;
+			};
+			std::vector<Body> bodies{ bodyAt(0) };
+			// 写入时已排序去重
+			if (std::adjacent_find(mod.Functions.begin(), mod.Functions.end(), std::greater_equal<>()) != mod.Functions.end())
+				fail();
+			for (auto f : mod.Functions) {
+				if (f == 0 || f >= code.size())
+					fail();
+				bodies.push_back(bodyAt(f));
+			}
+			std::sort(bodies.begin(), bodies.end(), [](const Body& a, const Body& b) { return a.Begin < b.Begin; });
+			// 每条指令所在的(最内层)函数，函数体必须正确嵌套
+			std::vector<size_t> owner(code.size(), 0);
+			std::vector<size_t> open;
+			size_t next = 0;
+			for (auto at : instrs) {
+				while (!open.empty() && at >= bodies[open.back()].End)
+					open.pop_back();
+				if (next < bodies.size() && bodies[next].Begin == at) {
+					if (!open.empty() && bodies[next].End > bodies[open.back()].End)
+						fail();
+					open.push_back(next++);
+				}
+				if (open.empty())
+					fail();
+				owner[at] = open.back();
+			}
+			if (next != bodies.size())
+				fail();
+			for (auto at : instrs) {
+				auto op = GetGenericOpcode(static_cast<Opcode>(code[at]));
+				auto size = GetOperandSize(op);
+				auto& body = bodies[owner[at]];
+				auto local = [&](size_t i) {
+					if (i >= body.Frame)
+						fail();
+				};
+				auto reg = [&](size_t offset) {
+					auto r = (Imm1)code[at + 1 + offset];
+					if (!(r & 0x80))
+						local(r);
+				};
+				// 比较条件与 Interpreter::Compare 接受的一致
+				auto compare = [&]() {
+					switch (static_cast<Opcode>(code[at + 1])) {
+					case OP_Equ:
+					case OP_Neq:
+					case OP_Gt:
+					case OP_Ge:
+					case OP_Lt:
+					case OP_Le:
+						break;
+					default:
+						fail();
+					}
+				};
+				switch (op) {
+				case OP_GetProp:
+				case OP_SetProp:
+				case OP_PushStr:
+				case OP_PushGlobalVar:
+				case OP_StoreGlobalVar:
+					if (operand(at, 0) >= mod.Strings.size())
+						fail();
+					break;
+				case OP_PushGlobal:
+				case OP_StoreGlobal:
+					if (operand(at, 0) >= mod.GlobalNames.size())
+						fail();
+					break;
+				case OP_PushFuncPtr:
+					if (!std::binary_search(mod.Functions.begin(), mod.Functions.end(), operand(at, 0)))
+						fail();
+					break;
+				case OP_PushLocalI1:
+				case OP_StoreLocalI1:
+					local((Imm1)code[at + 1]);
+					break;
+				case OP_PushLocalI4:
+				case OP_StoreLocalI4:
+					local(operand(at, 0));
+					break;
+				case OP_RMov:
+					reg(0);
+					reg(1);
+					break;
+				case OP_RLoadI:
+					reg(0);
+					break;
+				case OP_RAdd:
+				case OP_RSub:
+				case OP_RMul:
+				case OP_RDiv:
+					reg(0);
+					reg(1);
+					reg(2);
+					break;
+				case OP_RAddI:
+					reg(0);
+					reg(1);
+					break;
+				case OP_RCmpJnz:
+					compare();
+					reg(1);
+					reg(2);
+					break;
+				case OP_RCmpIJnz:
+					compare();
+					reg(1);
+					break;
+				default:
+					break;
+				}
+				switch (op) {
+				case OP_Jmp:
+				case OP_Jz:
+				case OP_Jnz:
+				case OP_MoveNext:
+				case OP_RCmpJnz:
+				case OP_RCmpIJnz: {
+					// 偏移总是最后一个操作数，相对于下一条指令
+					auto target = (int64_t)(at + 1 + size) + (Imm4)operand(at, size - sizeof(Imm4));
+					if (target < 0 || target >= (int64_t)code.size() || !starts[(size_t)target])
+						fail();
+					// 跳过函数体的 Jmp 落在外层函数中，其余跳转不能离开所在的函数
+					if (owner[(size_t)target] != owner[at])
+						fail();
+				} break;
+				default:
+					break;
+				}
+			}
+			ValidateStack(code, bodies);
+		}
+		/// <summary>
+		/// 检查栈深度：从每个函数的入口沿控制流传播相对于栈帧基址的深度，
+		/// 同一条指令从不同路径到达时深度必须相同，且任何指令都不能弹出栈帧以下的值。
+		/// 解释器与 JIT 因此不需要在每次出栈时检查栈底
+		/// </summary>
+		static void ValidateStack(std::span<const char> code, const std::vector<Body>& bodies) {
+			auto fail = []() {
+				throw std::runtime_error("Invalid bytecode file.");
+			};
+			std::vector<int64_t> depth(code.size(), -1);
+			std::vector<size_t> work;
+			auto reach = [&](size_t pc, int64_t d) {
+				if (depth[pc] < 0) {
+					depth[pc] = d;
+					work.push_back(pc);
+				}
+				else if (depth[pc] != d)
+					fail();
+			};
+			for (auto& body : bodies)
+				reach(body.Begin, 0);
+			while (!work.empty()) {
+				auto at = work.back();
+				work.pop_back();
+				auto op = GetGenericOpcode(static_cast<Opcode>(code[at]));
+				auto size = GetOperandSize(op);
+				auto next = at + 1 + size;
+				UImm4 n = 0;
+				if (size >= sizeof(UImm4))
+					memcpy(&n, &code[at + 1], sizeof(n));
+				// 弹出与压入的个数；跳转时压入的个数(只有 MoveNext 与顺序执行时不同)
+				int64_t pops = 0, pushes = 0, jumped = 0;
+				bool falls = true, jumps = false;
+				switch (op) {
+				case OP_Add:
+				case OP_Sub:
+				case OP_Div:
+				case OP_Mul:
+				case OP_Or:
+				case OP_And:
+				case OP_Band:
+				case OP_Bor:
+				case OP_Xor:
+				case OP_Equ:
+				case OP_Gt:
+				case OP_Lt:
+				case OP_Ge:
+				case OP_Le:
+				case OP_Neq:
+				case OP_Range:
+				case OP_SetProp:
+				case OP_GetIndex:
+					pops = 2;
+					pushes = 1;
+					break;
+				case OP_SetIndex:
+					pops = 3;
+					pushes = 1;
+					break;
+				case OP_GetProp:
+				case OP_Int32:
+				case OP_Int64:
+				case OP_Float:
+				case OP_Double:
+				case OP_String:
+				case OP_Neg:
+				case OP_Inc:
+				case OP_Dec:
+				case OP_Not:
+				case OP_Bnot:
+				case OP_BeginFor:
+				// Store 系列读取栈顶但不弹出
+				case OP_StoreArg:
+				case OP_StoreLocalI1:
+				case OP_StoreLocalI4:
+				case OP_StoreGlobal:
+				case OP_StoreGlobalVar:
+					pops = 1;
+					pushes = 1;
+					break;
+				case OP_Dup:
+					pops = 1;
+					pushes = 2;
+					break;
+				case OP_PushI4_1:
+				case OP_PushI4_0:
+				case OP_PushI4:
+				case OP_PushI8:
+				case OP_PushFP4:
+				case OP_PushFP8:
+				case OP_PushFuncPtr:
+				case OP_PushStr:
+				case OP_PushGlobalVar:
+				case OP_PushNull:
+				case OP_PushArg:
+				case OP_PushLocalI1:
+				case OP_PushLocalI4:
+				case OP_PushGlobal:
+					pushes = 1;
+					break;
+				case OP_PushN:
+					pushes = (unsigned char)code[at + 1];
+					break;
+				case OP_PushNI4:
+					pushes = n;
+					break;
+				case OP_Pop:
+					pops = 1;
+					break;
+				case OP_Popn:
+					pops = (unsigned char)code[at + 1];
+					break;
+				case OP_Call:
+					// 被调用者与参数，返回后压入返回值
+					pops = 1 + (int64_t)(unsigned char)code[at + 1];
+					pushes = 1;
+					break;
+				case OP_Jmp:
+					falls = false;
+					jumps = true;
+					break;
+				case OP_Jz:
+				case OP_Jnz:
+					pops = 1;
+					jumps = true;
+					break;
+				case OP_MoveNext:
+					pops = 2;
+					pushes = 1;
+					jumps = true;
+					break;
+				case OP_RCmpJnz:
+				case OP_RCmpIJnz:
+					jumps = true;
+					break;
+				case OP_Ret:
+				case OP_Throw:
+					pops = 1;
+					falls = false;
+					break;
+				case OP_RetNull:
+				case OP_Brk:
+				case OP_Err:
+					falls = false;
+					break;
+				default:
+					break;
+				}
+				auto d = depth[at];
+				if (d < pops)
+					fail();
+				// 函数体以返回或跳转结尾(见 Validate)，顺序执行不会越过代码的结尾
+				if (falls)
+					reach(next, d - pops + pushes);
+				if (jumps) {
+					// 目标已由 Validate 检查
+					Imm4 offset;
+					memcpy(&offset, &code[next - sizeof(offset)], sizeof(offset));
+					reach((size_t)((int64_t)next + offset), d - pops + jumped);
+				}
+			}
+		}
+	};
+	/// <summary>
+	/// 把 Emitter 的输出序列化为字节码文件的内容
+	/// </summary>
+	inline std::vector<char> SaveBytecode(const Emitter& em) {
+		return BytecodeWriter{}.Write(em);
+	}
+	inline void SaveBytecodeFile(const Emitter& em, const std::string& path) {
+		auto data = SaveBytecode(em);
+		std::ofstream fs(path, std::ios::binary);
+		if (!fs.write(data.data(), data.size()))
+			throw std::runtime_error("Cannot write bytecode file.");
+	}
+	/// <summary>
+	/// 解析字节码文件的内容，模块的 Code 指向 data，data 必须比模块存活得久。
+	/// 载入的模块在运行前需要 BindGlobals
+	/// </summary>
+	inline BytecodeModule LoadBytecode(std::span<const char> data) {
+		return BytecodeReader{ data }.Read();
+	}
+	/// <summary>
+	/// 读入并解析字节码文件，模块持有文件的内容。需要在多个解释器间共享代码时使用 MappedFile 与 LoadBytecode
+	/// </summary>
+	inline BytecodeModule LoadBytecodeFile(const std::string& path) {
+		std::ifstream fs(path, std::ios::binary);
+		if (!fs)
+			throw std::runtime_error("Cannot open bytecode file.");
+		std::vector<char> data{ std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>() };
+		auto mod = LoadBytecode(data);
+		// 移动不改变缓冲区的地址，Code 仍然有效
+		mod.Storage = std::move(data);
+		return mod;
+	}
+}
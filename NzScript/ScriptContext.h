@@ -2,30 +2,186 @@
 #include "ScriptVariant.h"
 #include <stack>
 #include <map>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <atomic>
 using ScriptInternMethod = Variant::ScriptInternMethod;
-class ScriptContext {
+/// <summary>
+/// 原生函数的参数，直接指向解释器栈上的值
+/// </summary>
+using NativeArgs = std::span<Variant>;
+/// <summary>
+/// 零分配调用约定的原生函数
+/// 参数不再复制到新的 vector 中，调用前按 MinArgs/MaxArgs 检查参数个数，不符合时抛出 Usage
+/// </summary>
+struct NativeFunction {
+	static constexpr size_t Variadic = (size_t)-1;
+	Variant (*Invoke)(class ScriptContext&, NativeArgs) = nullptr;
+	size_t MinArgs = 0;
+	size_t MaxArgs = Variadic;
+	std::string Usage = "Invalid argument count.";
+	Variant Call(class ScriptContext& ctx, Variant* args, size_t count) const {
+		if (count < MinArgs || count > MaxArgs)
+			throw std::exception(Usage.c_str());
+		return Invoke(ctx, NativeArgs{ args, count });
+	}
+};
+/// <summary>
+/// 取得 C++ 函数(函数指针或无捕获的 lambda)的返回值与参数类型
+/// </summary>
+template <class T>
+struct NativeSignature : NativeSignature<decltype(&T::operator())> {};
+template <class R, class... A>
+struct NativeSignature<R (*)(A...)> {
+	using Return = R;
+	using Args = std::tuple<A...>;
+	static constexpr size_t Arity = sizeof...(A);
+};
+template <class C, class R, class... A>
+struct NativeSignature<R (C::*)(A...) const> : NativeSignature<R (*)(A...)> {};
+/// <summary>
+/// 把脚本的值转换为 C++ 参数；浮点数直接取 Double，其余情况才按类型分派
+/// </summary>
+template <class T>
+T FromVariant(const Variant& v) {
+	using U = std::remove_cvref_t<T>;
+	if constexpr (std::is_same_v<U, Variant>)
+		return v;
+	else if constexpr (std::is_same_v<U, bool>)
+		return (bool)v;
+	else if constexpr (std::is_floating_point_v<U>)
+		return (U)(v.Type == Variant::DataType::Double ? v.Double : script_cast<double>(v));
+	else if constexpr (std::is_integral_v<U>)
+		return (U)(v.Type == Variant::DataType::Int ? v.Int : script_cast<long long>(v));
+	else
+		static_assert(std::is_same_v<U, Variant>, "Unsupported native argument type.");
+}
+/// <summary>
+/// 把 C++ 的返回值转换为脚本的值
+/// </summary>
+template <class T>
+Variant ToVariant(T r) {
+	if constexpr (std::is_same_v<T, Variant>)
+		return r;
+	else if constexpr (std::is_same_v<T, bool>)
+		return Variant{ r ? 1 : 0 };
+	else if constexpr (std::is_same_v<T, float>)
+		return Variant{ r };
+	else if constexpr (std::is_floating_point_v<T>)
+		return Variant{ (double)r };
+	else if constexpr (std::is_integral_v<T> && sizeof(T) <= sizeof(int))
+		return Variant{ (int)r };
+	else if constexpr (std::is_integral_v<T>)
+		return Variant{ (long long)r };
+	else
+		static_assert(std::is_same_v<T, Variant>, "Unsupported native return type.");
+}
+/// <summary>
+/// 由 ScriptContext::Bind 生成的调用桩：参数个数在编译期已知，展开后直接调用 Fn
+/// </summary>
+template <auto Fn>
+Variant NativeThunk(class ScriptContext& ctx, NativeArgs vars) {
+	using Sig = NativeSignature<decltype(Fn)>;
+	return [&]<size_t... I>(std::index_sequence<I...>) -> Variant {
+		if constexpr (std::is_void_v<typename Sig::Return>) {
+			Fn(FromVariant<std::tuple_element_t<I, typename Sig::Args>>(vars[I])...);
+			return {};
+		}
+		else {
+			return ToVariant(Fn(FromVariant<std::tuple_element_t<I, typename Sig::Args>>(vars[I])...));
+		}
+	}(std::make_index_sequence<Sig::Arity>{});
+}
+/// <summary>
+/// 脚本上下文
+///
+/// 全局变量在发射指令时解析为槽位(GlobalSlot)，解释器直接读写 Globals[槽位]。
+/// 常量与内部函数也有槽位，值在创建槽位时从 InternalConstants/NativeFunctions/InternalFunctions 复制；它们是只读的。
+/// 上下文本身是 GC 的根集合来源，Globals 中的对象不会被回收。
+/// </summary>
+class ScriptContext : public GCRootSource {
 public:
 	std::unordered_map<std::string, ScriptInternMethod> InternalFunctions;
+	/// <summary>
+	/// 以 NativeFunction 约定注册的函数，Variant 中保存指向这里的指针(unordered_map 的元素地址不会变化)
+	/// </summary>
+	std::unordered_map<std::string, NativeFunction> NativeFunctions;
 	std::unordered_map<std::string, Variant> InternalConstants;
-	std::unordered_map<std::string, Variant> GlobalVars;
+	/// <summary>
+	/// 全局变量的值，以槽位为下标
+	/// </summary>
+	std::vector<Variant> Globals;
+	/// <summary>
+	/// 槽位对应的名称
+	/// </summary>
+	std::vector<std::string> GlobalNames;
+	std::unordered_map<std::string, size_t> GlobalSlots;
+	/// <summary>
+	/// 驻留字符串表，键指向字符串对象自身的内容
+	/// </summary>
+	std::unordered_map<std::string_view, GCString*> InternedStrings;
 	GC gc;
+	/// <summary>
+	/// 进程内唯一的编号(从 1 开始)。新上下文可能复用已销毁上下文的地址，按上下文缓存的数据以编号区分
+	/// </summary>
+	const size_t Id = ++NextId();
 	ScriptContext() {
 		InternalConstants["null"] = {};
 		InternalConstants["false"] = Variant{ 0 };
 		InternalConstants["true"] = Variant{ 1 };
+		gc.AddRootSource(this);
+	}
+	~ScriptContext() {
+		gc.RemoveRootSource(this);
+	}
+
+private:
+	static std::atomic<size_t>& NextId() {
+		static std::atomic<size_t> id = 0;
+		return id;
+	}
+
+public:
+	void TraceRoots(GC& gc) override {
+		for (auto& v : Globals)
+			v.Trace(gc);
 	}
 	bool GlobalExists(const std::string& name) {
+		// 被引用过的名称(包括内部函数)都已经分配了槽位，先查这里
+		if (GlobalSlots.find(name) != GlobalSlots.end()) {
+			return true;
+		}
 		if (InternalConstants.find(name) != InternalConstants.end()) {
 			return true;
 		}
 		if (InternalFunctions.find(name) != InternalFunctions.end()) {
 			return true;
 		}
-		if (GlobalVars.find(name) != GlobalVars.end()) {
+		if (NativeFunctions.find(name) != NativeFunctions.end()) {
 			return true;
 		}
 		return false;
 	}
+	/// <summary>
+	/// 常量与内部函数不能被脚本覆盖
+	/// </summary>
+	bool IsReadOnlyGlobal(const std::string& name) {
+		return InternalConstants.contains(name) || InternalFunctions.contains(name) || NativeFunctions.contains(name);
+	}
+	/// <summary>
+	/// 取得全局变量的槽位，不存在时创建
+	/// </summary>
+	size_t GlobalSlot(const std::string& name) {
+		auto it = GlobalSlots.find(name);
+		if (it != GlobalSlots.end())
+			return it->second;
+		auto slot = Globals.size();
+		Globals.push_back(LookupGlobal(name));
+		GlobalNames.push_back(name);
+		GlobalSlots.emplace(name, slot);
+		return slot;
+	}
 	Variant LookupGlobal(std::string name) {
 		if (InternalConstants.find(name) != InternalConstants.end()) {
 			return InternalConstants[name];
@@ -36,25 +192,89 @@ public:
 			v.InternMethod = InternalFunctions[name];
 			return v;
 		}
-		if (GlobalVars.find(name) != GlobalVars.end()) {
-			return GlobalVars[name];
+		auto native = NativeFunctions.find(name);
+		if (native != NativeFunctions.end()) {
+			Variant v{};
+			v.Type = Variant::DataType::NativeMethod;
+			v.Native = &native->second;
+			return v;
+		}
+		auto it = GlobalSlots.find(name);
+		if (it != GlobalSlots.end()) {
+			return Globals[it->second];
 		}
 
 		return {};
 	}
 
+	/// <summary>
+	/// 设置堆预算：分配超过 budget 字节时自动回收，回收后预算变为存活字节数的 growth 倍；
+	/// limit 不为 0 时，回收后仍然超过 limit 会使脚本抛出异常
+	/// </summary>
+	void ConfigureHeap(size_t budget, double growth = 2.0, size_t limit = 0) {
+		gc.Configure({ budget, growth, limit });
+	}
+	/// <summary>
+	/// 取得内容为 s 的驻留字符串。驻留字符串是 GC 的根，与上下文一同存活
+	/// </summary>
+	Variant Intern(std::string_view s) {
+		Variant v{};
+		v.Type = Variant::DataType::String;
+		auto it = InternedStrings.find(s);
+		if (it != InternedStrings.end()) {
+			v.Object = it->second;
+			return v;
+		}
+		auto str = new (gc) GCString(gc, s);
+		str->Interned = true;
+		gc.AddRoot(str);
+		InternedStrings.emplace(str->View(), str);
+		v.Object = str;
+		return v;
+	}
 	void AddConstant(std::string name, Variant v) {
 		InternalConstants[name] = v;
+		RefreshGlobal(name);
+	}
+	/// <summary>
+	/// 注册内部函数。已经分配了槽位的名称会同时更新槽位中的值，直接写 InternalFunctions 则不会
+	/// </summary>
+	void AddFunction(const std::string& name, ScriptInternMethod fn) {
+		InternalFunctions[name] = fn;
+		RefreshGlobal(name);
 	}
-	void SetGlobalVar(std::string name, Variant v) {
-		if (InternalConstants.find(name) == InternalConstants.end())
-		{
-			auto& v2 = GlobalVars[name];
-			if (v2.Type == Variant::DataType::Object || v2.Type == Variant::DataType::String)
-				gc.RemoveRoot(v2.Object);
-			if (v.Type == Variant::DataType::Object || v.Type == Variant::DataType::String)
-				gc.AddRoot(v.Object);
-			v2 = v;
+	void SetGlobalVar(const std::string& name, Variant v) {
+		if (IsReadOnlyGlobal(name))
+			return;
+		Globals[GlobalSlot(name)] = v;
+	}
+	/// <summary>
+	/// 把 C++ 函数注册为脚本函数，参数的解包在编译期生成
+	/// 例：ctx.Bind<[](double x) { return std::sin(x); }>("sin");
+	/// </summary>
+	/// <typeparam name="Fn">函数指针或无捕获的 lambda</typeparam>
+	/// <param name="name">脚本中的名称</param>
+	template <auto Fn>
+	void Bind(const std::string& name) {
+		constexpr auto arity = NativeSignature<decltype(Fn)>::Arity;
+		std::string usage = "Usage: " + name + "(";
+		for (size_t i = 0; i < arity; i++) {
+			if (i != 0)
+				usage += ",";
+			usage += arity == 1 ? 'x' : (char)('a' + i);
 		}
+		usage += ").";
+		NativeFunctions[name] = { NativeThunk<Fn>, arity, arity, usage };
+		RefreshGlobal(name);
+	}
+
+private:
+	/// <summary>
+	/// 常量或函数注册后，按 LookupGlobal 的优先级重新取得已有槽位的值
+	/// </summary>
+	void RefreshGlobal(const std::string& name) {
+		auto it = GlobalSlots.find(name);
+		if (it != GlobalSlots.end())
+			Globals[it->second] = LookupGlobal(name);
 	}
 };
\ No newline at end of file
@@ -1,53 +1,301 @@
 ﻿#include <mutex>
-#include <unordered_set>
 #include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <new>
+#include <string_view>
 /// <summary>
 /// GC 对象
 /// </summary>
 class GCObject {
+	friend class GC;
+	class GC* Owner;
+	// 以下字段由 GC 维护
+	bool Marked = false;
+	// 是否已晋升到老年代
+	bool Old = false;
+	// 是否在记忆集中(老年代对象引用了新生代对象)
+	bool Remembered = false;
+	// 经历过的新生代回收次数
+	unsigned char Age = 0;
+
+protected:
+	// 子类设置的类型标记，解释器据此判断对象类型而不必比较 type_info
+	unsigned char Kind = 0;
+
+private:
+	// 计入堆预算的字节数
+	size_t Size = 0;
+
 public:
-	std::unordered_set<GCObject*> References;
+	unsigned char GetKind() const noexcept {
+		return Kind;
+	}
 	virtual ~GCObject() {
 	}
 	virtual const std::type_info& GetType() const noexcept {
 		return typeid(GCObject);
 	}
-	GCObject(class GC& gc);
-	void AddRef(GCObject* ref) {
-		References.insert(ref);
-	}
-	void RemoveRef(GCObject* ref) {
-		References.erase(ref);
+	/// <summary>
+	/// 创建对象并加入 GC，size 为计入堆预算的字节数(通常是 sizeof 加上额外持有的内存)
+	/// </summary>
+	GCObject(class GC& gc, size_t size = sizeof(GCObject));
+	/// <summary>
+	/// 对每个引用的对象调用 gc.Visit，由持有引用的子类实现
+	/// </summary>
+	virtual void Trace(class GC& gc) {
 	}
+	/// <summary>
+	/// 写屏障：保存对象引用后调用
+	/// </summary>
+	void WriteBarrier(GCObject* ref);
+
+protected:
+	/// <summary>
+	/// 对象额外持有的内存(如元素数组)从 before 字节变为 after 字节后调用，使增长计入堆预算
+	/// </summary>
+	void Account(size_t before, size_t after);
+
+public:
+	/// <summary>
+	/// 从 GC 的分级分配器中分配：new (gc) ScriptObject(gc)
+	/// </summary>
+	static void* operator new(size_t size, class GC& gc);
+	// 构造函数抛出异常时调用
+	static void operator delete(void* p, class GC& gc);
+	// 虚析构函数使 delete 传入实际类型的大小
+	static void operator delete(void* p, size_t size);
 };
-class GCString : public GCObject {
+/// <summary>
+/// 按大小分级的分配器
+///
+/// 小对象按 Granule 对齐分为若干级，每级从 ChunkSize 对齐的区块中顺序分配(移动指针)，
+/// 释放的单元挂到该级的空闲链表上，下一次分配时优先复用；区块头记录所属的分配器与级别，
+/// 释放时根据地址找到区块，不需要额外的对象头。超过 MaxSmall 的对象直接使用全局 new。
+/// </summary>
+class GCArena {
 public:
-	char* Pointer;
-	GCString(GC& gc, const char* s) : Pointer(_strdup(s)), GCObject(gc) {}
-	virtual const std::type_info& GetType() const noexcept {
-		return typeid(GCString);
+	static constexpr size_t ChunkSize = 64 << 10;
+	static constexpr size_t Granule = 16;
+	static constexpr size_t MaxSmall = 512;
+
+private:
+	static constexpr size_t ClassCount = MaxSmall / Granule;
+	struct Chunk {
+		GCArena* Owner;
+		size_t Class;
+	};
+	static constexpr size_t HeaderSize = (sizeof(Chunk) + Granule - 1) / Granule * Granule;
+	struct FreeCell {
+		FreeCell* Next;
+	};
+	struct SizeClass {
+		char* Bump = nullptr;
+		char* End = nullptr;
+		FreeCell* Free = nullptr;
+	};
+	SizeClass Classes[ClassCount];
+	std::vector<Chunk*> Chunks;
+
+	static size_t ClassOf(size_t size) {
+		return (std::max<size_t>(size, 1) + Granule - 1) / Granule - 1;
 	}
-	~GCString() {
-		free(Pointer);
+	static Chunk* ChunkOf(void* p) {
+		return (Chunk*)((uintptr_t)p & ~(uintptr_t)(ChunkSize - 1));
+	}
+	void NewChunk(size_t cls) {
+		auto chunk = (Chunk*)::operator new(ChunkSize, std::align_val_t{ ChunkSize });
+		chunk->Owner = this;
+		chunk->Class = cls;
+		Chunks.push_back(chunk);
+		auto cell = (cls + 1) * Granule;
+		auto& c = Classes[cls];
+		c.Bump = (char*)chunk + HeaderSize;
+		c.End = c.Bump + (ChunkSize - HeaderSize) / cell * cell;
+	}
+
+public:
+	GCArena() = default;
+	GCArena(const GCArena&) = delete;
+	GCArena& operator=(const GCArena&) = delete;
+	~GCArena() {
+		for (auto chunk : Chunks)
+			::operator delete(chunk, std::align_val_t{ ChunkSize });
+	}
+	void* Allocate(size_t size) {
+		if (size > MaxSmall)
+			return ::operator new(size);
+		auto cls = ClassOf(size);
+		auto& c = Classes[cls];
+		if (c.Free != nullptr) {
+			auto p = c.Free;
+			c.Free = p->Next;
+			return p;
+		}
+		auto cell = (cls + 1) * Granule;
+		if (c.Bump == c.End)
+			NewChunk(cls);
+		auto p = c.Bump;
+		c.Bump += cell;
+		return p;
+	}
+	/// <summary>
+	/// 释放 Allocate 分配的内存，size 必须与分配时相同
+	/// </summary>
+	static void Deallocate(void* p, size_t size) {
+		if (size > MaxSmall) {
+			::operator delete(p);
+			return;
+		}
+		auto chunk = ChunkOf(p);
+		auto cell = (FreeCell*)p;
+		auto& c = chunk->Owner->Classes[chunk->Class];
+		cell->Next = c.Free;
+		c.Free = cell;
+	}
+	/// <summary>
+	/// p 是否位于本分配器的区块中
+	/// </summary>
+	bool Owns(void* p) {
+		return std::find(Chunks.begin(), Chunks.end(), ChunkOf(p)) != Chunks.end();
+	}
+	size_t ChunkCount() {
+		return Chunks.size();
 	}
 };
 /// <summary>
+/// 根集合的来源，例如解释器的计算栈；回收时由 GC 调用 TraceRoots 访问其中的每个引用
+/// </summary>
+class GCRootSource {
+public:
+	virtual ~GCRootSource() {
+	}
+	virtual void TraceRoots(class GC& gc) = 0;
+};
+/// <summary>
+/// GC 的统计信息
+/// </summary>
+struct GCStats {
+	size_t MinorCollections = 0;
+	size_t MajorCollections = 0;
+	// 暂停时间(毫秒)
+	double LastPause = 0;
+	double MaxPause = 0;
+	double TotalPause = 0;
+	// 上一次回收释放的对象数
+	size_t LastFreed = 0;
+	size_t TotalFreed = 0;
+	size_t TotalPromoted = 0;
+};
+/// <summary>
+/// 堆预算
+/// </summary>
+struct GCHeapOptions {
+	// 分配的字节数超过预算时在下一个安全点回收，为 0 时不自动回收
+	size_t Budget = 4 << 20;
+	// 回收后预算调整为存活字节数的 Growth 倍(不低于 Budget)
+	double Growth = 2.0;
+	// 不为 0 时，全量回收后存活字节数仍然超过 Limit 会抛出异常
+	size_t Limit = 0;
+};
+/// <summary>
 /// GC 上下文类
+///
+/// 分代回收：新对象进入新生代，熬过 TenureAge 次回收后晋升到老年代。
+/// 新生代回收只标记新生代对象，老年代对象视为存活，引用了新生代对象的老年代对象由写屏障(WriteBarrier)记录在记忆集中；
+/// 老年代增长到上次全量回收后的 MajorGrowth 倍时才进行全量回收。
+/// 标记使用显式的标记栈，不会因为很长的链表耗尽本机栈。
+/// 分配超过堆预算(GCHeapOptions)时只设置标志，由解释器在安全点调用 Poll 进行回收。
+/// 对象与字符串的内存来自 GCArena，GC 销毁时释放所有对象。
 /// </summary>
 class GC {
 	std::mutex _lock;
-	std::unordered_set<GCObject*> Objects;
+	// 必须先于对象列表构造、后于它们销毁
+	GCArena Arena;
+	std::vector<GCObject*> Nursery;
+	std::vector<GCObject*> OldSpace;
+	std::vector<GCObject*> RememberedSet;
+	std::vector<GCObject*> MarkStack;
 	std::unordered_map<GCObject*, int> Roots;
+	std::vector<GCRootSource*> RootSources;
+	size_t NextMajor = MinMajorThreshold;
+	GCHeapOptions Heap;
+	size_t Bytes = 0;
+	size_t NextCollect = Heap.Budget;
+	bool CollectRequested = false;
+	enum class TraceMode {
+		MarkAll,
+		MarkYoung,
+		// 只检查是否引用了新生代对象
+		FindYoung,
+	} Mode = TraceMode::MarkAll;
+	bool FoundYoung = false;
 
 public:
+	/// <summary>
+	/// 对象熬过多少次新生代回收后晋升
+	/// </summary>
+	static constexpr unsigned char TenureAge = 2;
+	static constexpr size_t MinMajorThreshold = 1024;
+	static constexpr size_t MajorGrowth = 2;
+	GCStats Stats;
+
+	GC() = default;
+	GC(const GC&) = delete;
+	GC& operator=(const GC&) = delete;
+	~GC() {
+		for (auto obj : Nursery)
+			delete obj;
+		for (auto obj : OldSpace)
+			delete obj;
+	}
+	void* Allocate(size_t size) {
+		std::lock_guard<std::mutex> lock(_lock);
+		return Arena.Allocate(size);
+	}
+	bool Owns(void* p) {
+		std::lock_guard<std::mutex> lock(_lock);
+		return Arena.Owns(p);
+	}
+	/// <summary>
+	/// 分配器持有的区块数
+	/// </summary>
+	size_t ChunkCount() {
+		return Arena.ChunkCount();
+	}
 	size_t ObjectCount() {
-		return Objects.size();
+		return Nursery.size() + OldSpace.size();
+	}
+	size_t NurseryCount() {
+		return Nursery.size();
+	}
+	size_t OldCount() {
+		return OldSpace.size();
+	}
+	/// <summary>
+	/// 当前计入堆预算的字节数
+	/// </summary>
+	size_t HeapBytes() {
+		return Bytes;
+	}
+	/// <summary>
+	/// 下一次自动回收时的字节数
+	/// </summary>
+	size_t HeapBudget() {
+		return NextCollect;
+	}
+	void Configure(const GCHeapOptions& opts) {
+		std::lock_guard<std::mutex> lock(_lock);
+		Heap = opts;
+		UpdateBudget();
 	}
 	void AddRoot(GCObject* obj) {
 		std::lock_guard<std::mutex> lock(_lock);
 		Roots[obj]++;
-		Objects.insert(obj);
 	}
 
 	void RemoveRoot(GCObject* obj) {
@@ -57,52 +305,293 @@ public:
 			Roots.erase(obj);
 	}
 
-	void AddObject(GCObject* obj) {
+	void AddRootSource(GCRootSource* src) {
 		std::lock_guard<std::mutex> lock(_lock);
-		Objects.insert(obj);
+		RootSources.push_back(src);
 	}
-
-	void Collect() {
+	void RemoveRootSource(GCRootSource* src) {
 		std::lock_guard<std::mutex> lock(_lock);
+		std::erase(RootSources, src);
+	}
 
-		std::unordered_set<GCObject*> marked;
-		std::unordered_set<GCObject*> unmarked;
-
-		// Mark all objects reachable from the roots
-		for (auto root : Roots) {
-			Mark(root.first, marked);
+	void AddObject(GCObject* obj, size_t size) {
+		std::lock_guard<std::mutex> lock(_lock);
+		obj->Owner = this;
+		obj->Size = size;
+		Nursery.push_back(obj);
+		Bytes += size;
+		if (Heap.Budget != 0 && Bytes >= NextCollect)
+			CollectRequested = true;
+	}
+	/// <summary>
+	/// 对象持有的内存增加(或减少) delta 字节，超过预算时同样只设置标志
+	/// </summary>
+	void Account(GCObject* obj, ptrdiff_t delta) {
+		std::lock_guard<std::mutex> lock(_lock);
+		obj->Size += delta;
+		Bytes += delta;
+		if (Heap.Budget != 0 && Bytes >= NextCollect)
+			CollectRequested = true;
+	}
+	/// <summary>
+	/// 构造函数抛出异常时调用：撤销 GCObject 构造函数中的 AddObject 并释放 p 处的内存
+	/// </summary>
+	void Abandon(void* p) {
+		std::lock_guard<std::mutex> lock(_lock);
+		// 单继承时 GCObject 子对象位于分配的起始处；构造过程中可能又创建了其他对象，从后往前找
+		auto it = std::find(Nursery.rbegin(), Nursery.rend(), (GCObject*)p);
+		if (it != Nursery.rend()) {
+			Bytes -= (*it)->Size;
+			Nursery.erase(std::next(it).base());
 		}
-
-		// Unmark all objects that are not reachable from the roots
-		for (auto obj : Objects) {
-			if (marked.find(obj) == marked.end()) {
-				unmarked.insert(obj);
-			}
+		// 不在区块中的是超过 MaxSmall 的大对象，小对象按区块记录的级别回收
+		if (Arena.Owns(p))
+			GCArena::Deallocate(p, GCArena::Granule);
+		else
+			::operator delete(p);
+	}
+	/// <summary>
+	/// 安全点：分配超过预算时进行回收。调用者必须保证所有存活的值都能从根访问到
+	/// </summary>
+	void Poll() {
+		if (!CollectRequested)
+			return;
+		Collect();
+		if (Heap.Limit != 0 && Bytes > Heap.Limit) {
+			Collect(true);
+			if (Bytes > Heap.Limit)
+				throw std::runtime_error("Heap limit exceeded.");
 		}
-
-		// Delete all unmarked objects
-		if (unmarked.size() == 0)
+	}
+	/// <summary>
+	/// 写屏障：老年代对象引用了新生代对象
+	/// </summary>
+	void Remember(GCObject* obj) {
+		std::lock_guard<std::mutex> lock(_lock);
+		if (obj->Remembered)
 			return;
-		std::cerr << "Erased " << unmarked.size() << " objects.\n";
-		for (auto obj : unmarked) {
-			Objects.erase(obj);
-			delete obj;
+		obj->Remembered = true;
+		RememberedSet.push_back(obj);
+	}
+	/// <summary>
+	/// 由 GCObject::Trace 对每个引用调用
+	/// </summary>
+	void Visit(GCObject* obj) {
+		if (obj == nullptr)
+			return;
+		switch (Mode) {
+		case TraceMode::MarkAll:
+			Push(obj, false);
+			break;
+		case TraceMode::MarkYoung:
+			Push(obj, true);
+			break;
+		case TraceMode::FindYoung:
+			FoundYoung |= !obj->Old;
+			break;
 		}
 	}
+	/// <summary>
+	/// 回收垃圾，full 为 false 时由 GC 决定进行新生代回收还是全量回收
+	/// </summary>
+	void Collect(bool full = false) {
+		std::lock_guard<std::mutex> lock(_lock);
+		auto begin = std::chrono::steady_clock::now();
+		size_t freed;
+		if (full || OldSpace.size() >= NextMajor) {
+			freed = CollectMajor();
+			Stats.MajorCollections++;
+			NextMajor = std::max(MinMajorThreshold, OldSpace.size() * MajorGrowth);
+		}
+		else {
+			freed = CollectMinor();
+			Stats.MinorCollections++;
+		}
+		auto pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		Stats.LastPause = pause;
+		Stats.MaxPause = std::max(Stats.MaxPause, pause);
+		Stats.TotalPause += pause;
+		Stats.LastFreed = freed;
+		Stats.TotalFreed += freed;
+		UpdateBudget();
+	}
 
 private:
-	void Mark(GCObject* obj, std::unordered_set<GCObject*>& marked) {
-		if (marked.find(obj) != marked.end()) {
+	void UpdateBudget() {
+		CollectRequested = false;
+		NextCollect = std::max(Heap.Budget, (size_t)(Bytes * Heap.Growth));
+		if (Heap.Limit != 0)
+			NextCollect = std::min(NextCollect, Heap.Limit);
+		if (Heap.Budget != 0 && Bytes >= NextCollect)
+			CollectRequested = true;
+	}
+	void Free(GCObject* obj) {
+		Bytes -= obj->Size;
+		delete obj;
+	}
+	void Push(GCObject* obj, bool minor) {
+		if (obj->Marked || (minor && obj->Old))
 			return;
+		obj->Marked = true;
+		MarkStack.push_back(obj);
+	}
+	void PushRoots(bool minor) {
+		for (auto& [root, count] : Roots) {
+			Push(root, minor);
 		}
-
-		marked.insert(obj);
-
-		for (auto ref : obj->References) {
-			Mark(ref, marked);
+		Mode = minor ? TraceMode::MarkYoung : TraceMode::MarkAll;
+		for (auto src : RootSources) {
+			src->TraceRoots(*this);
 		}
 	}
+	void Mark(bool minor) {
+		Mode = minor ? TraceMode::MarkYoung : TraceMode::MarkAll;
+		while (!MarkStack.empty()) {
+			auto obj = MarkStack.back();
+			MarkStack.pop_back();
+			obj->Trace(*this);
+		}
+	}
+	bool HasYoungReference(GCObject* obj) {
+		Mode = TraceMode::FindYoung;
+		FoundYoung = false;
+		obj->Trace(*this);
+		return FoundYoung;
+	}
+	/// <summary>
+	/// 清扫新生代：释放未标记的对象，存活对象增长年龄并按需晋升
+	/// </summary>
+	size_t SweepNursery() {
+		size_t freed = 0, kept = 0;
+		for (auto obj : Nursery) {
+			if (!obj->Marked) {
+				Free(obj);
+				freed++;
+				continue;
+			}
+			obj->Marked = false;
+			if (++obj->Age < TenureAge) {
+				Nursery[kept++] = obj;
+				continue;
+			}
+			obj->Old = true;
+			OldSpace.push_back(obj);
+			Stats.TotalPromoted++;
+			if (HasYoungReference(obj)) {
+				obj->Remembered = true;
+				RememberedSet.push_back(obj);
+			}
+		}
+		Nursery.resize(kept);
+		return freed;
+	}
+	/// <summary>
+	/// 去掉记忆集中不再引用新生代对象的老年代对象
+	/// </summary>
+	void FilterRememberedSet() {
+		size_t kept = 0;
+		for (auto obj : RememberedSet) {
+			if (HasYoungReference(obj))
+				RememberedSet[kept++] = obj;
+			else
+				obj->Remembered = false;
+		}
+		RememberedSet.resize(kept);
+	}
+	size_t CollectMinor() {
+		PushRoots(true);
+		for (auto obj : RememberedSet) {
+			obj->Trace(*this);
+		}
+		Mark(true);
+		auto freed = SweepNursery();
+		FilterRememberedSet();
+		return freed;
+	}
+	size_t CollectMajor() {
+		PushRoots(false);
+		Mark(false);
+		// 释放对象前先把它们从记忆集中去掉
+		size_t kept = 0;
+		for (auto obj : RememberedSet) {
+			if (obj->Marked)
+				RememberedSet[kept++] = obj;
+		}
+		RememberedSet.resize(kept);
+		size_t freed = 0;
+		kept = 0;
+		for (auto obj : OldSpace) {
+			if (!obj->Marked) {
+				Free(obj);
+				freed++;
+				continue;
+			}
+			obj->Marked = false;
+			OldSpace[kept++] = obj;
+		}
+		OldSpace.resize(kept);
+		freed += SweepNursery();
+		FilterRememberedSet();
+		return freed;
+	}
+};
+GCObject::GCObject(GC& gc, size_t size) {
+	gc.AddObject(this, size);
+}
+void GCObject::Account(size_t before, size_t after) {
+	if (before != after)
+		Owner->Account(this, (ptrdiff_t)after - (ptrdiff_t)before);
+}
+void* GCObject::operator new(size_t size, GC& gc) {
+	return gc.Allocate(size);
+}
+void GCObject::operator delete(void* p, GC& gc) {
+	gc.Abandon(p);
+}
+void GCObject::operator delete(void* p, size_t size) {
+	GCArena::Deallocate(p, size);
+}
+/// <summary>
+/// 不可变字符串，保存长度与哈希值
+/// </summary>
+class GCString : public GCObject {
+	static char* Copy(GC& gc, std::string_view s) {
+		auto p = (char*)gc.Allocate(s.size() + 1);
+		memcpy(p, s.data(), s.size());
+		p[s.size()] = 0;
+		return p;
+	}
+
+public:
+	const size_t Length;
+	const size_t Hash;
+	const char* const Pointer;
+	// 是否在 ScriptContext 的驻留字符串表中
+	bool Interned = false;
+	GCString(GC& gc, std::string_view s)
+		: GCObject(gc, sizeof(GCString) + s.size() + 1), Length(s.size()), Hash(std::hash<std::string_view>{}(s)), Pointer(Copy(gc, s)) {
+	}
+	GCString(GC& gc, const char* s) : GCString(gc, std::string_view(s)) {
+	}
+	virtual const std::type_info& GetType() const noexcept {
+		return typeid(GCString);
+	}
+	~GCString() {
+		GCArena::Deallocate((void*)Pointer, Length + 1);
+	}
+	std::string_view View() const {
+		return { Pointer, Length };
+	}
+	static bool Equals(const GCString* a, const GCString* b) {
+		if (a == b)
+			return true;
+		// 内容相同的驻留字符串是同一个对象
+		if (a->Interned && b->Interned)
+			return false;
+		return a->Length == b->Length && a->Hash == b->Hash && memcmp(a->Pointer, b->Pointer, a->Length) == 0;
+	}
 };
-GCObject::GCObject(GC& gc) {
-	gc.AddObject(this);
-}
\ No newline at end of file
+void GCObject::WriteBarrier(GCObject* ref) {
+	if (Old && !Remembered && !ref->Old)
+		Owner->Remember(this);
+}
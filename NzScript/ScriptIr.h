@@ -4,7 +4,8 @@
 #include <set>
 #include <stack>
 #include <stdexcept>
-#include <stack>
+#include <unordered_map>
+#include <algorithm>
 #include "ScriptVariant.h"
 #include "ScriptContext.h"
 /*
@@ -25,6 +26,7 @@ Call 1
 ```
 
 对于 Jit 函数内部忽略调用规定(x64 call)，统一使用从左到右的栈调用约定(std call)
+Jit 函数(见 ScriptJit.h 中的 x64::Compiler)的参数与本地变量仍然位于计算堆栈上，栈帧布局与解释器相同，因此两者可以互相调用
 */
 namespace ir {
 	using Imm1 = unsigned char;
@@ -135,9 +137,65 @@ namespace ir {
 		OP_Brk,
 		OP_Err,
 		OP_Throw,
+		// foreach 的迭代协议(见 RangeForStatement)：
+		// 从栈上依次弹出下标与迭代源，下标越界时跳转到结束(offset imm4)，否则压入该元素
 		OP_MoveNext,
+		// 弹出要遍历的值，压入迭代源：数组、数值数组与区间是它们本身，对象是属性名数组的快照
 		OP_BeginFor,
 
+		// 读取全局变量(槽位 uimm4，见 ScriptContext::GlobalSlot)
+		OP_PushGlobal,
+		// 把栈顶的值存储到全局变量(槽位 uimm4)
+		OP_StoreGlobal,
+		// 用栈顶的两个整数创建区间对象(a..b)
+		OP_Range,
+		// 压入 n 个 null(uimm4)，用于本地变量超过 255 个的栈帧
+		OP_PushNI4,
+
+		// 寄存器形式的指令，由 LowerToRegisters 从栈指令改写而来
+		// 寄存器(imm1)直接对应栈帧中的槽位：0~127 为本地变量，最高位为 1 时为参数
+		// dst = src(reg,reg)
+		OP_RMov,
+		// dst = imm4(reg,imm4)
+		OP_RLoadI,
+		// dst = a op b(reg,reg,reg)
+		OP_RAdd,
+		OP_RSub,
+		OP_RMul,
+		OP_RDiv,
+		// dst = a + imm4(reg,reg,imm4)
+		OP_RAddI,
+		// 比较两个寄存器，比较结果为假时跳转(cond,reg,reg,offset imm4)，cond 为对应的比较指令
+		OP_RCmpJnz,
+		// 比较寄存器与立即数，比较结果为假时跳转(cond,reg,imm4,offset imm4)
+		OP_RCmpIJnz,
+
+		// 特化指令：解释器观察到操作数类型后就地改写得到，操作数与对应的通用指令相同(见 GetGenericOpcode)
+		// _II 要求两个操作数都是 Int，_DD 都是 Double，_I 要求寄存器是 Int；类型不符时改回通用指令
+		OP_Add_II,
+		OP_Sub_II,
+		OP_Mul_II,
+		OP_Equ_II,
+		OP_Neq_II,
+		OP_Gt_II,
+		OP_Ge_II,
+		OP_Lt_II,
+		OP_Le_II,
+		OP_Add_DD,
+		OP_Sub_DD,
+		OP_Mul_DD,
+		OP_Div_DD,
+		OP_Gt_DD,
+		OP_Ge_DD,
+		OP_Lt_DD,
+		OP_Le_DD,
+		OP_RAdd_II,
+		OP_RSub_II,
+		OP_RMul_II,
+		OP_RAddI_I,
+		OP_RCmpJnz_II,
+		OP_RCmpIJnz_I,
+
 		// No operation
 		OP_Nop = 0xff,
 	};
@@ -244,6 +302,7 @@ namespace ir {
 		case ir::OP_Brk:
 			return "Brk";
 		case ir::OP_PushN:
+		case ir::OP_PushNI4:
 			return "InitStk";
 		case ir::OP_PushArg:
 			return "PushArg";
@@ -255,16 +314,205 @@ namespace ir {
 			return "StoreLocal";
 		case ir::OP_PushGlobalVar:
 			return "PushGVar";
+		case ir::OP_PushGlobal:
+			return "PushGlobal";
+		case ir::OP_StoreGlobal:
+			return "StoreGlobal";
+		case ir::OP_Range:
+			return "Range";
 		case ir::OP_Err:
 			return "DEBUGBREAK";
 		case ir::OP_Throw:
 			return "Throw";
 		case ir::OP_MoveNext:
 			return "MoveNext";
+		case ir::OP_BeginFor:
+			return "BeginFor";
+		case ir::OP_RMov:
+			return "RMov";
+		case ir::OP_RLoadI:
+			return "RLoadI";
+		case ir::OP_RAdd:
+			return "RAdd";
+		case ir::OP_RSub:
+			return "RSub";
+		case ir::OP_RMul:
+			return "RMul";
+		case ir::OP_RDiv:
+			return "RDiv";
+		case ir::OP_RAddI:
+			return "RAddI";
+		case ir::OP_RCmpJnz:
+			return "RCmpJnz";
+		case ir::OP_RCmpIJnz:
+			return "RCmpIJnz";
+		case ir::OP_Add_II:
+			return "Add.II";
+		case ir::OP_Sub_II:
+			return "Sub.II";
+		case ir::OP_Mul_II:
+			return "Mul.II";
+		case ir::OP_Equ_II:
+			return "Equ.II";
+		case ir::OP_Neq_II:
+			return "Neq.II";
+		case ir::OP_Gt_II:
+			return "Gt.II";
+		case ir::OP_Ge_II:
+			return "Ge.II";
+		case ir::OP_Lt_II:
+			return "Lt.II";
+		case ir::OP_Le_II:
+			return "Le.II";
+		case ir::OP_Add_DD:
+			return "Add.DD";
+		case ir::OP_Sub_DD:
+			return "Sub.DD";
+		case ir::OP_Mul_DD:
+			return "Mul.DD";
+		case ir::OP_Div_DD:
+			return "Div.DD";
+		case ir::OP_Gt_DD:
+			return "Gt.DD";
+		case ir::OP_Ge_DD:
+			return "Ge.DD";
+		case ir::OP_Lt_DD:
+			return "Lt.DD";
+		case ir::OP_Le_DD:
+			return "Le.DD";
+		case ir::OP_RAdd_II:
+			return "RAdd.II";
+		case ir::OP_RSub_II:
+			return "RSub.II";
+		case ir::OP_RMul_II:
+			return "RMul.II";
+		case ir::OP_RAddI_I:
+			return "RAddI.I";
+		case ir::OP_RCmpJnz_II:
+			return "RCmpJnz.II";
+		case ir::OP_RCmpIJnz_I:
+			return "RCmpIJnz.I";
 		default:
 			return "Unknown";
 		}
 	}
+	/// <summary>
+	/// 获取特化指令对应的通用指令，其余指令原样返回
+	/// </summary>
+	constexpr Opcode GetGenericOpcode(Opcode op) {
+		switch (op) {
+		case OP_Add_II:
+		case OP_Add_DD:
+			return OP_Add;
+		case OP_Sub_II:
+		case OP_Sub_DD:
+			return OP_Sub;
+		case OP_Mul_II:
+		case OP_Mul_DD:
+			return OP_Mul;
+		case OP_Div_DD:
+			return OP_Div;
+		case OP_Equ_II:
+			return OP_Equ;
+		case OP_Neq_II:
+			return OP_Neq;
+		case OP_Gt_II:
+		case OP_Gt_DD:
+			return OP_Gt;
+		case OP_Ge_II:
+		case OP_Ge_DD:
+			return OP_Ge;
+		case OP_Lt_II:
+		case OP_Lt_DD:
+			return OP_Lt;
+		case OP_Le_II:
+		case OP_Le_DD:
+			return OP_Le;
+		case OP_RAdd_II:
+			return OP_RAdd;
+		case OP_RSub_II:
+			return OP_RSub;
+		case OP_RMul_II:
+			return OP_RMul;
+		case OP_RAddI_I:
+			return OP_RAddI;
+		case OP_RCmpJnz_II:
+			return OP_RCmpJnz;
+		case OP_RCmpIJnz_I:
+			return OP_RCmpIJnz;
+		default:
+			return op;
+		}
+	}
+	/// <summary>
+	/// 获取指令操作数的长度(不含操作码本身)
+	/// </summary>
+	constexpr size_t GetOperandSize(Opcode op) {
+		switch (GetGenericOpcode(op)) {
+		case OP_GetProp:
+		case OP_SetProp:
+		case OP_PushStr:
+		case OP_PushGlobalVar:
+		case OP_StoreGlobalVar:
+		case OP_PushGlobal:
+		case OP_StoreGlobal:
+		case OP_PushI4:
+		case OP_PushFP4:
+		case OP_PushFuncPtr:
+		case OP_PushLocalI4:
+		case OP_StoreLocalI4:
+		case OP_PushNI4:
+		case OP_Jmp:
+		case OP_Jz:
+		case OP_Jnz:
+		case OP_MoveNext:
+			return 4;
+		case OP_PushI8:
+		case OP_PushFP8:
+			return 8;
+		case OP_Call:
+		case OP_PushArg:
+		case OP_StoreArg:
+		case OP_PushLocalI1:
+		case OP_StoreLocalI1:
+		case OP_Popn:
+		case OP_PushN:
+			return 1;
+		case OP_RMov:
+			return 2;
+		case OP_RAdd:
+		case OP_RSub:
+		case OP_RMul:
+		case OP_RDiv:
+			return 3;
+		case OP_RLoadI:
+			return 5;
+		case OP_RAddI:
+			return 6;
+		case OP_RCmpJnz:
+			return 7;
+		case OP_RCmpIJnz:
+			return 10;
+		default:
+			return 0;
+		}
+	}
+	/// <summary>
+	/// 行号表的一项：从 PC 开始(直到下一项)的指令属于源代码的第 Line 行
+	/// </summary>
+	struct LineEntry {
+		unsigned int PC;
+		unsigned int Line;
+	};
+	/// <summary>
+	/// 查找 PC 处的指令所在的行，没有记录时返回 0
+	/// </summary>
+	inline unsigned int LineAt(const std::vector<LineEntry>& lines, size_t pc) {
+		auto it = std::upper_bound(lines.begin(), lines.end(), pc, [](size_t pc, const LineEntry& e) {
+			return pc < e.PC;
+		});
+		return it == lines.begin() ? 0 : std::prev(it)->Line;
+	}
 	class Emitter {
 	public:
 		template <class Operand>
@@ -303,12 +551,39 @@ namespace ir {
 				return (Opcode&)em->Bytes[ptr];
 			}
 			auto& GetOperand() {
-				return (std::string&)em->Strings[(*(Operand*)&em->Bytes[ptr + 1])];
+				// 常量池中的字符串被索引，不允许修改
+				return (const std::string&)em->Strings[(*(Operand*)&em->Bytes[ptr + 1])];
 			}
 		};
 		ScriptContext* ctx = 0;
 		std::vector<char> Bytes;
 		std::vector<std::string> Strings;
+		// Strings 的反向索引，查找与去重都是常数时间
+		std::unordered_map<std::string, unsigned int> StringIndex;
+		/// <summary>
+		/// 取得字符串在常量池中的编号，不存在时加入
+		/// </summary>
+		unsigned int AddString(const std::string& str) {
+			auto [it, inserted] = StringIndex.try_emplace(str, (unsigned int)Strings.size());
+			if (inserted)
+				Strings.push_back(str);
+			return it->second;
+		}
+		// 行号表，按 PC 升序
+		std::vector<LineEntry> Lines;
+		/// <summary>
+		/// 记录之后发射的指令属于第 line 行
+		/// </summary>
+		void MarkLine(unsigned int line) {
+			auto pc = (unsigned int)Bytes.size();
+			if (!Lines.empty() && Lines.back().PC == pc) {
+				Lines.back().Line = line;
+				return;
+			}
+			if (!Lines.empty() && Lines.back().Line == line)
+				return;
+			Lines.push_back({ pc, line });
+		}
 		auto EmitOp(Opcode opc) {
 			Operation<void> op{ this, Bytes.size() };
 			Bytes.push_back(opc);
@@ -347,23 +622,7 @@ namespace ir {
 		auto EmitOp(Opcode opc, const std::string& str) {
 			OperationWithString<unsigned int> ows{ this, Bytes.size() };
 			Bytes.push_back(opc);
-
-			int i = 0;
-			bool found = false;
-			for (auto& str1 : Strings) {
-				if (str1 == str) {
-					found = true;
-					break;
-				}
-				i++;
-			}
-			if (!found) {
-				Strings.push_back(str);
-				Emit((int)Strings.size() - 1);
-				return ows;
-			}
-			Emit(i);
-
+			Emit(AddString(str));
 			return ows;
 		}
 		void Emit(auto imm) {
@@ -373,91 +632,139 @@ namespace ir {
 			memcpy(&*where, &imm, sizeof(imm));
 		}
 
-		std::vector<std::string> Arguments;
-		std::vector<std::string> LocalVariables;
-		void EmitOpPushVar(const std::string& str) {
-			if (str == "null") {
-				EmitOp(Opcode::OP_PushNull);
-				return;
-			}
-			int i = 0;
-			bool found = false;
-			for (auto& str1 : Arguments) {
-				if (str1 == str) {
-					found = true;
-					break;
-				}
-				i++;
-			}
-			if (found) {
-				EmitOpI1(Opcode::OP_PushArg, i);
+		/// <summary>
+		/// 分配一个编译器使用的临时本地变量，名称不会与脚本中的标识符冲突
+		/// </summary>
+		std::string NewTemporary() {
+			auto name = "#t" + std::to_string(LocalVariables.size());
+			ImplicitLocals.emplace(name, (unsigned int)LocalVariables.size());
+			LocalVariables.push_back(name);
+			return name;
+		}
+		/// <summary>
+		/// 发射读取全局变量的指令：有上下文时解析为槽位，否则按名称查找
+		/// </summary>
+		void EmitOpPushGlobal(const std::string& name) {
+			if (ctx == nullptr) {
+				EmitOp(Opcode::OP_PushGlobalVar, name);
 				return;
 			}
-			if (ctx != nullptr) {
-				if (ctx->GlobalExists(str)) {
-					EmitOp(Opcode::OP_PushGlobalVar, str);
-					return;
-				}
-			}
-			i = 0;
-			found = false;
-			for (auto& str1 : LocalVariables) {
-				if (str1 == str) {
-					found = true;
-					break;
-				}
-				i++;
-			}
-			if (found) {
-				EmitOpI1(Opcode::OP_PushLocalI1, i);
+			EmitOp(Opcode::OP_PushGlobal, (int)ctx->GlobalSlot(name));
+		}
+		/// <summary>
+		/// 发射存储全局变量的指令(值留在栈上)
+		/// </summary>
+		void EmitOpStoreGlobal(const std::string& name) {
+			if (ctx == nullptr) {
+				EmitOp(Opcode::OP_StoreGlobalVar, name);
 				return;
 			}
-			else {
-				LocalVariables.push_back(str);
-				EmitOpI1(Opcode::OP_PushLocalI1, static_cast<unsigned char>(LocalVariables.size() - 1));
+			// 对常量与内部函数的赋值没有效果，不需要任何指令
+			if (ctx->IsReadOnlyGlobal(name))
 				return;
+			EmitOp(Opcode::OP_StoreGlobal, (int)ctx->GlobalSlot(name));
+		}
+
+		/// <summary>
+		/// 变量解析的结果
+		/// </summary>
+		struct Symbol {
+			enum class SymbolKind {
+				Argument,
+				Local,
+				Global,
+			} Kind;
+			// 参数下标或本地变量槽位
+			unsigned int Index;
+		};
+		std::vector<std::string> Arguments;
+		// 本地变量槽位对应的名称
+		std::vector<std::string> LocalVariables;
+		// 参数名到下标
+		std::unordered_map<std::string, unsigned int> ArgumentIndex;
+		// 块作用域，每层是 let 声明的名称到槽位的映射，内层遮蔽外层
+		std::vector<std::unordered_map<std::string, unsigned int>> Scopes = std::vector<std::unordered_map<std::string, unsigned int>>(1);
+		// 没有声明、第一次使用时创建的本地变量，作用于整个函数
+		std::unordered_map<std::string, unsigned int> ImplicitLocals;
+		void PushScope() {
+			Scopes.emplace_back();
+		}
+		void PopScope() {
+			Scopes.pop_back();
+		}
+		/// <summary>
+		/// 在当前块作用域中声明本地变量，返回槽位。同一作用域中重复声明使用同一个槽位
+		/// </summary>
+		unsigned int DeclareLocal(const std::string& name) {
+			auto [it, inserted] = Scopes.back().try_emplace(name, (unsigned int)LocalVariables.size());
+			if (inserted)
+				LocalVariables.push_back(name);
+			return it->second;
+		}
+		/// <summary>
+		/// 解析名称：块作用域(由内向外)、参数、全局变量，最后是隐式本地变量(不存在时创建)
+		/// </summary>
+		Symbol Resolve(const std::string& name) {
+			for (auto scope = Scopes.rbegin(); scope != Scopes.rend(); ++scope) {
+				auto it = scope->find(name);
+				if (it != scope->end())
+					return { Symbol::SymbolKind::Local, it->second };
 			}
+			auto arg = ArgumentIndex.find(name);
+			if (arg != ArgumentIndex.end())
+				return { Symbol::SymbolKind::Argument, arg->second };
+			if (ctx != nullptr && ctx->GlobalExists(name))
+				return { Symbol::SymbolKind::Global, 0 };
+			auto [it, inserted] = ImplicitLocals.try_emplace(name, (unsigned int)LocalVariables.size());
+			if (inserted)
+				LocalVariables.push_back(name);
+			return { Symbol::SymbolKind::Local, it->second };
 		}
-		void EmitOpStoreVar(const std::string& str) {
+		/// <summary>
+		/// 发射访问本地变量的指令，槽位超过 imm1 的范围时使用 imm4 的形式
+		/// </summary>
+		void EmitOpLocal(Opcode i1, Opcode i4, unsigned int slot) {
+			if (slot <= 0xff)
+				EmitOpI1(i1, static_cast<unsigned char>(slot));
+			else
+				EmitOp(i4, (int)slot);
+		}
+		void EmitOpStoreLocal(unsigned int slot) {
+			EmitOpLocal(Opcode::OP_StoreLocalI1, Opcode::OP_StoreLocalI4, slot);
+		}
+		void EmitOpPushVar(const std::string& str) {
 			if (str == "null") {
+				EmitOp(Opcode::OP_PushNull);
 				return;
 			}
-			int i = 0;
-			bool found = false;
-			for (auto& str1 : Arguments) {
-				if (str1 == str) {
-					found = true;
-					break;
-				}
-				i++;
-			}
-			if (found) {
-				EmitOpI1(Opcode::OP_StoreArg, i);
-				return;
-			}
-			if (ctx != nullptr) {
-				if (ctx->GlobalExists(str)) {
-					EmitOp(Opcode::OP_StoreGlobalVar, str);
-					return;
-				}
-			}
-			i = 0;
-			found = false;
-			for (auto& str1 : LocalVariables) {
-				if (str1 == str) {
-					found = true;
-					break;
-				}
-				i++;
+			auto sym = Resolve(str);
+			switch (sym.Kind) {
+			case Symbol::SymbolKind::Argument:
+				EmitOpI1(Opcode::OP_PushArg, static_cast<unsigned char>(sym.Index));
+				break;
+			case Symbol::SymbolKind::Global:
+				EmitOpPushGlobal(str);
+				break;
+			case Symbol::SymbolKind::Local:
+				EmitOpLocal(Opcode::OP_PushLocalI1, Opcode::OP_PushLocalI4, sym.Index);
+				break;
 			}
-			if (found) {
-				EmitOpI1(Opcode::OP_StoreLocalI1, i);
+		}
+		void EmitOpStoreVar(const std::string& str) {
+			if (str == "null") {
 				return;
 			}
-			else {
-				LocalVariables.push_back(str);
-				EmitOpI1(Opcode::OP_StoreLocalI1, static_cast<unsigned char>(LocalVariables.size() - 1));
-				return;
+			auto sym = Resolve(str);
+			switch (sym.Kind) {
+			case Symbol::SymbolKind::Argument:
+				EmitOpI1(Opcode::OP_StoreArg, static_cast<unsigned char>(sym.Index));
+				break;
+			case Symbol::SymbolKind::Global:
+				EmitOpStoreGlobal(str);
+				break;
+			case Symbol::SymbolKind::Local:
+				EmitOpStoreLocal(sym.Index);
+				break;
 			}
 		}
 		enum LateBindPointType {
@@ -498,5 +805,47 @@ namespace ir {
 			}
 			LateBinds.clear();
 		}
+		/// <summary>
+		/// 单个函数的编译状态
+		/// 嵌套函数直接发射到同一个 Bytes 与 Strings 中，只需要切换这部分状态
+		/// </summary>
+		struct FunctionState {
+			std::vector<std::string> Arguments;
+			std::vector<std::string> LocalVariables;
+			std::vector<LateBindPoint> LateBinds;
+			std::unordered_map<std::string, unsigned int> ArgumentIndex;
+			std::vector<std::unordered_map<std::string, unsigned int>> Scopes;
+			std::unordered_map<std::string, unsigned int> ImplicitLocals;
+		};
+		/// <summary>
+		/// 开始编译参数为 args 的嵌套函数，返回外层函数的状态
+		/// </summary>
+		FunctionState EnterFunction(std::vector<std::string> args) {
+			// 参数使用 imm1 寻址
+			if (args.size() > 0x100)
+				throw std::runtime_error("Too many parameters.");
+			FunctionState outer{ std::move(Arguments), std::move(LocalVariables), std::move(LateBinds),
+				std::move(ArgumentIndex), std::move(Scopes), std::move(ImplicitLocals) };
+			Arguments = std::move(args);
+			LocalVariables.clear();
+			LateBinds.clear();
+			ArgumentIndex.clear();
+			for (unsigned int i = 0; i < Arguments.size(); i++)
+				ArgumentIndex.try_emplace(Arguments[i], i);
+			Scopes.assign(1, {});
+			ImplicitLocals.clear();
+			return outer;
+		}
+		/// <summary>
+		/// 结束嵌套函数，恢复外层函数的状态
+		/// </summary>
+		void LeaveFunction(FunctionState& outer) {
+			Arguments = std::move(outer.Arguments);
+			LocalVariables = std::move(outer.LocalVariables);
+			LateBinds = std::move(outer.LateBinds);
+			ArgumentIndex = std::move(outer.ArgumentIndex);
+			Scopes = std::move(outer.Scopes);
+			ImplicitLocals = std::move(outer.ImplicitLocals);
+		}
 	};
 }
\ No newline at end of file
@@ -4,12 +4,41 @@
 #include <set>
 #include <stack>
 #include <stdexcept>
-#include <stack>
+#include <map>
+#include <deque>
+#include <memory>
+#include <climits>
+#include <cstddef>
+#include <exception>
+#include <utility>
+#include <span>
+#include <unordered_map>
 #include "ScriptVariant.h"
 #include "ScriptContext.h"
 #include "ScriptIr.h"
+// GCC/Clang 支持取标签地址(computed goto)，可以使用直接线索化的分派方式
+#if defined(__GNUC__) || defined(__clang__)
+#define NZ_COMPUTED_GOTO 1
+#else
+#define NZ_COMPUTED_GOTO 0
+#endif
+// x86-64 上热点函数会被编译为本机代码，定义 NZ_NO_JIT 可以关闭
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(NZ_NO_JIT)
+#define NZ_JIT 1
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#else
+#define NZ_JIT 0
+#endif
 // This impls a simple stack.
-class SimpStack {
+// 运行期间作为 GC 的根集合，[0, sp) 中的对象不会被回收
+class SimpStack : public GCRootSource {
 	Variant blank_val{};
 
 public:
@@ -77,12 +106,14 @@ public:
 		return ptr[i];
 	}
 	void pop() {
-		sp--;
+		if (sp != 0)
+			sp--;
 	}
 	void push(const Variant& v) {
-		ptr[sp++] = v;
+		// 先检查再写入，载入的字节码可能把栈压到末尾
 		if (sp >= max)
 			throw std::runtime_error("Stack overflow.");
+		ptr[sp++] = v;
 	}
 	Variant& get_arg(size_t i) {
 		if (bp + i >= bp2 - 3)
@@ -92,6 +123,14 @@ public:
 	Variant& get_local(size_t i) {
 		return ptr[bp2 + i];
 	}
+	/// <summary>
+	/// 获取寄存器形式指令的操作数(最高位为 1 时是参数，否则是本地变量)
+	/// </summary>
+	Variant& get_reg(unsigned char r) {
+		if (r & 0x80)
+			return get_arg(r & 0x7f);
+		return ptr[bp2 + r];
+	}
 	Variant& get_lr() {
 		return ptr[bp2 - 1]; // Linked address
 	}
@@ -109,6 +148,13 @@ public:
 	/// </summary>
 	/// <returns>PC</returns>
 	size_t pop_frame() {
+		// 帧链接可能被错误的字节码覆盖，恢复前先确认它们仍指向更低的栈帧
+		auto& lastBp = get_last_bp();
+		auto& lastBp2 = get_last_bp2();
+		if (get_lr().Type != Variant::DataType::ReturnPC
+			|| lastBp.Type != Variant::DataType::Ptr || lastBp2.Type != Variant::DataType::Ptr
+			|| lastBp2.Pointer >= bp2 || lastBp.Pointer > lastBp2.Pointer || bp > bp2 - 3)
+			throw std::runtime_error("Corrupted stack frame.");
 		auto lr = get_lr().Pointer;
 		// 重置栈指针
 		sp = bp;
@@ -125,146 +171,1326 @@ public:
 	Variant* end() {
 		return &ptr[sp];
 	}
+	void TraceRoots(GC& gc) override {
+		for (size_t i = 0; i < sp; i++)
+			ptr[i].Trace(gc);
+	}
 };
+#if NZ_JIT
+namespace ir::x64 {
+	enum Reg : unsigned char {
+		RAX,
+		RCX,
+		RDX,
+		RBX,
+		RSP,
+		RBP,
+		RSI,
+		RDI,
+		R8,
+		R9,
+		R10,
+		R11,
+		R12,
+		R13,
+		R14,
+		R15,
+	};
+	// 条件码的最低位取反即为相反条件
+	enum Cond : unsigned char {
+		CondB = 0x2,
+		CondAE = 0x3,
+		CondE = 0x4,
+		CondNE = 0x5,
+		CondBE = 0x6,
+		CondL = 0xC,
+		CondGE = 0xD,
+		CondLE = 0xE,
+		CondG = 0xF,
+	};
+#ifdef _WIN64
+	constexpr Reg Arg0 = RCX;
+	constexpr Reg Arg1 = RDX;
+	// 32 字节影子空间，再加 8 字节保持 16 字节对齐
+	constexpr int FrameSize = 40;
+#else
+	constexpr Reg Arg0 = RDI;
+	constexpr Reg Arg1 = RSI;
+	constexpr int FrameSize = 8;
+#endif
+	/// <summary>
+	/// 代码中的跳转目标，绑定前的引用会在绑定时回填
+	/// </summary>
+	struct Label {
+		size_t Pos = (size_t)-1;
+		std::vector<size_t> Fixups;
+	};
+	/// <summary>
+	/// 只包含 JIT 用到的少量 x86-64 指令的汇编器
+	/// </summary>
+	class Assembler {
+		void Rex(bool w, int reg, int base) {
+			unsigned char rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (base >> 3);
+			if (rex != 0x40)
+				Byte(rex);
+		}
+		// [base + disp32]
+		void Mem(int reg, Reg base, int disp) {
+			Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+			if ((base & 7) == RSP)
+				Byte(0x24);
+			Dword(disp);
+		}
+		void Direct(int reg, int rm) {
+			Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+		}
+		void Ref(Label& l) {
+			if (l.Pos != (size_t)-1) {
+				Dword((unsigned int)(l.Pos - (Code.size() + 4)));
+				return;
+			}
+			l.Fixups.push_back(Code.size());
+			Dword(0);
+		}
+
+	public:
+		std::vector<unsigned char> Code;
+
+		void Byte(unsigned char b) {
+			Code.push_back(b);
+		}
+		void Dword(unsigned int v) {
+			Code.insert(Code.end(), (unsigned char*)&v, (unsigned char*)(&v + 1));
+		}
+		void Qword(unsigned long long v) {
+			Code.insert(Code.end(), (unsigned char*)&v, (unsigned char*)(&v + 1));
+		}
+		void Bind(Label& l) {
+			l.Pos = Code.size();
+			for (auto at : l.Fixups) {
+				auto rel = (unsigned int)(l.Pos - (at + 4));
+				memcpy(&Code[at], &rel, sizeof(rel));
+			}
+			l.Fixups.clear();
+		}
+		void Push(Reg r) {
+			Rex(false, 0, r);
+			Byte(0x50 + (r & 7));
+		}
+		void Pop(Reg r) {
+			Rex(false, 0, r);
+			Byte(0x58 + (r & 7));
+		}
+		void Ret() {
+			Byte(0xC3);
+		}
+		void MovImm64(Reg r, unsigned long long v) {
+			Rex(true, 0, r);
+			Byte(0xB8 + (r & 7));
+			Qword(v);
+		}
+		// 写入 32 位寄存器时高 32 位清零
+		void MovImm32(Reg r, unsigned int v) {
+			Rex(false, 0, r);
+			Byte(0xB8 + (r & 7));
+			Dword(v);
+		}
+		void Mov(Reg dst, Reg src) {
+			Rex(true, src, dst);
+			Byte(0x89);
+			Direct(src, dst);
+		}
+		void Load64(Reg dst, Reg base, int disp) {
+			Rex(true, dst, base);
+			Byte(0x8B);
+			Mem(dst, base, disp);
+		}
+		void Load32(Reg dst, Reg base, int disp) {
+			Rex(false, dst, base);
+			Byte(0x8B);
+			Mem(dst, base, disp);
+		}
+		void Store64(Reg base, int disp, Reg src) {
+			Rex(true, src, base);
+			Byte(0x89);
+			Mem(src, base, disp);
+		}
+		void Store32(Reg base, int disp, Reg src) {
+			Rex(false, src, base);
+			Byte(0x89);
+			Mem(src, base, disp);
+		}
+		// 64 位写入时立即数做符号扩展
+		void StoreImm(Reg base, int disp, int imm, bool wide) {
+			Rex(wide, 0, base);
+			Byte(0xC7);
+			Mem(0, base, disp);
+			Dword(imm);
+		}
+		// ext: 0 add, 5 sub, 7 cmp
+		void AluImm(int ext, Reg r, int imm, bool wide) {
+			Rex(wide, 0, r);
+			Byte(0x81);
+			Direct(ext, r);
+			Dword(imm);
+		}
+		void AluMemImm(int ext, Reg base, int disp, int imm, bool wide) {
+			Rex(wide, 0, base);
+			Byte(0x81);
+			Mem(ext, base, disp);
+			Dword(imm);
+		}
+		void Add(Reg dst, Reg src) {
+			Rex(true, src, dst);
+			Byte(0x01);
+			Direct(src, dst);
+		}
+		void Sub(Reg dst, Reg src) {
+			Rex(true, src, dst);
+			Byte(0x29);
+			Direct(src, dst);
+		}
+		// op: 0x03 add, 0x2B sub, 0x3B cmp; 32 位，右操作数在内存中
+		void Alu32(unsigned char op, Reg dst, Reg base, int disp) {
+			Rex(false, dst, base);
+			Byte(op);
+			Mem(dst, base, disp);
+		}
+		void Imul32(Reg dst, Reg base, int disp) {
+			Rex(false, dst, base);
+			Byte(0x0F);
+			Byte(0xAF);
+			Mem(dst, base, disp);
+		}
+		// ext: 4 shl, 5 shr
+		void Shift(int ext, Reg r, unsigned char n) {
+			Rex(true, 0, r);
+			Byte(0xC1);
+			Direct(ext, r);
+			Byte(n);
+		}
+		// ext: 0 inc, 1 dec
+		void IncDec64(int ext, Reg base, int disp) {
+			Rex(true, 0, base);
+			Byte(0xFF);
+			Mem(ext, base, disp);
+		}
+		// 只用于 RAX/RCX/RDX/RBX，不需要 REX 前缀
+		void Setcc(Cond c, Reg r) {
+			Byte(0x0F);
+			Byte(0x90 + c);
+			Direct(0, r);
+			// movzx r32, r8
+			Byte(0x0F);
+			Byte(0xB6);
+			Direct(r, r);
+		}
+		void Test32(Reg a, Reg b) {
+			Rex(false, b, a);
+			Byte(0x85);
+			Direct(b, a);
+		}
+		// 通过 xmm0 复制一个 16 字节的 Variant
+		void Copy16(Reg dst, int ddisp, Reg src, int sdisp) {
+			Rex(false, 0, src);
+			Byte(0x0F);
+			Byte(0x10);
+			Mem(0, src, sdisp);
+			Rex(false, 0, dst);
+			Byte(0x0F);
+			Byte(0x11);
+			Mem(0, dst, ddisp);
+		}
+		void Call(Reg r) {
+			Rex(false, 0, r);
+			Byte(0xFF);
+			Direct(2, r);
+		}
+		void Jmp(Label& l) {
+			Byte(0xE9);
+			Ref(l);
+		}
+		void Jcc(Cond c, Label& l) {
+			Byte(0x0F);
+			Byte(0x80 + c);
+			Ref(l);
+		}
+	};
+	/// <summary>
+	/// 一段只读可执行内存
+	/// </summary>
+	class ExecutableMemory {
+		void* Base = nullptr;
+		size_t Size = 0;
+
+	public:
+		ExecutableMemory() = default;
+		ExecutableMemory(const ExecutableMemory&) = delete;
+		ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+		~ExecutableMemory() {
+			if (Base == nullptr)
+				return;
+#ifdef _WIN32
+			VirtualFree(Base, 0, MEM_RELEASE);
+#else
+			munmap(Base, Size);
+#endif
+		}
+		/// <summary>
+		/// 复制代码并将内存设为可执行(W^X，写入完成后去掉写权限)
+		/// </summary>
+		bool Commit(const std::vector<unsigned char>& code) {
+			Size = code.size();
+#ifdef _WIN32
+			Base = VirtualAlloc(nullptr, Size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (Base == nullptr)
+				return false;
+			memcpy(Base, code.data(), Size);
+			DWORD old;
+			return VirtualProtect(Base, Size, PAGE_EXECUTE_READ, &old);
+#else
+			Base = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (Base == MAP_FAILED) {
+				Base = nullptr;
+				return false;
+			}
+			memcpy(Base, code.data(), Size);
+			return mprotect(Base, Size, PROT_READ | PROT_EXEC) == 0;
+#endif
+		}
+		const void* Get() const {
+			return Base;
+		}
+	};
+	/// <summary>
+	/// 本机代码访问解释器状态所需的地址
+	/// </summary>
+	struct Runtime {
+		const SimpStack* Stack;
+		// int (*)(Interpreter*, size_t): 用解释器执行 pc 处的一条指令
+		const void* Step;
+		// int (*)(Interpreter*, size_t): 执行 pc 处的 OP_Call
+		const void* Call;
+		// 以函数入口的 PC 为下标的本机函数表，未编译的为 nullptr；表的地址在解释器的生命期内不变
+		const void* const* Functions;
+		size_t FunctionCount;
+		// 解释器的 PC，本机代码返回前写入返回地址
+		size_t* PC;
+	};
+	/// <summary>
+	/// 基线编译器：把一个函数的字节码逐条翻译为本机代码。
+	///
+	/// 调用约定与解释器一致：参数由调用者从左到右压入计算堆栈，返回地址与上一个栈帧保存在参数之后，
+	/// 本机函数只接收解释器指针，返回 Interpreter::JitStatus。
+	/// 寄存器分配：RBX 解释器，R12 &Stack.sp，R13 栈底，R14 本地变量，R15 参数，RBP 参数个数。
+	/// 操作数全部留在计算堆栈上，整数运算、变量读写与条件跳转走内联的快速路径，
+	/// 其余情况调用 Step 交给解释器执行同一条指令。
+	/// 调用已编译的脚本函数时直接建立栈帧并 call 它的本机代码，返回时也直接恢复调用者的栈帧；
+	/// 未编译的函数与原生函数仍由 Call 交给解释器。
+	/// </summary>
+	class Compiler {
+		static constexpr int TypeOffset = offsetof(Variant, Type);
+		static constexpr int IntType = (int)Variant::DataType::Int;
+		static constexpr int FuncPCType = (int)Variant::DataType::FuncPC;
+		static constexpr int ReturnPCType = (int)Variant::DataType::ReturnPC;
+		// 与 Interpreter::JitStatus 一致
+		static constexpr int Taken = 1;
+		static constexpr int Return = 2;
+		static constexpr int Error = 3;
+
+		std::span<const char> Bytes;
+		Runtime Rt;
+		Assembler As;
+		std::map<size_t, Label> Labels;
+		Label Exit;
+		struct SlowPath {
+			Label Entry;
+			size_t PC;
+			size_t Next;
+			// 分支指令的目标，非分支为 -1
+			size_t Target;
+			// Step 或 Call
+			const void* Helper;
+		};
+		std::deque<SlowPath> Slows;
+
+		template <class T>
+		T Operand(size_t pc, size_t offset = 0) {
+			T v;
+			memcpy(&v, &Bytes[pc + 1 + offset], sizeof(T));
+			return v;
+		}
+		static bool IsBranch(Opcode op) {
+			return op == OP_Jz || op == OP_Jnz || op == OP_RCmpJnz || op == OP_RCmpIJnz || op == OP_MoveNext;
+		}
+		static bool IsTerminator(Opcode op) {
+			return op == OP_Jmp || op == OP_Ret || op == OP_RetNull || op == OP_Throw || op == OP_Err;
+		}
+		size_t Next(size_t pc) {
+			return pc + 1 + GetOperandSize(static_cast<Opcode>(Bytes[pc]));
+		}
+		// 分支偏移总是最后一个操作数
+		size_t Target(size_t pc) {
+			auto next = Next(pc);
+			Imm4 off;
+			memcpy(&off, &Bytes[next - sizeof(Imm4)], sizeof(off));
+			return next + off;
+		}
+		/// <summary>
+		/// 从入口开始沿控制流找出函数的所有指令，遇到无法编译的指令时失败
+		/// </summary>
+		bool Discover(size_t entry) {
+			std::vector<size_t> work{ entry };
+			while (!work.empty()) {
+				auto pc = work.back();
+				work.pop_back();
+				if (pc >= Bytes.size())
+					return false;
+				if (Labels.contains(pc))
+					continue;
+				Labels[pc];
+				auto op = GetGenericOpcode(static_cast<Opcode>(Bytes[pc]));
+				switch (op) {
+				case OP_Brk:
+					return false;
+				default:
+					break;
+				}
+				if (op == OP_Jmp || IsBranch(op))
+					work.push_back(Target(pc));
+				if (!IsTerminator(op))
+					work.push_back(Next(pc));
+			}
+			return true;
+		}
+		Label& Slow(size_t pc, size_t target = (size_t)-1) {
+			Slows.push_back({ {}, pc, Next(pc), target, Rt.Step });
+			return Slows.back().Entry;
+		}
+		void CallHelper(const void* fn, size_t pc) {
+			As.Mov(Arg0, RBX);
+			As.MovImm32(Arg1, (unsigned int)pc);
+			As.MovImm64(RAX, (unsigned long long)fn);
+			As.Call(RAX);
+		}
+		// 状态非 0 时离开本机函数
+		void CheckStatus() {
+			As.Test32(RAX, RAX);
+			As.Jcc(CondNE, Exit);
+		}
+		// RAX = &ptr[sp]
+		void StackTop() {
+			As.Load64(RAX, R12, 0);
+			As.Shift(4, RAX, 4);
+			As.Add(RAX, R13);
+		}
+		// 与 SimpStack::push 一致：压入 n 个值后 sp 到达 max 时交给慢速路径抛出异常
+		void StackReserve(int n, Label& slow) {
+			As.Load64(RAX, R12, 0);
+			As.AluImm(7, RAX, (int)(Rt.Stack->max - n), true);
+			As.Jcc(CondAE, slow);
+			As.Shift(4, RAX, 4);
+			As.Add(RAX, R13);
+		}
+		void StoreConst(Reg base, int disp, Variant::DataType type, unsigned long long payload) {
+			if ((long long)payload == (int)payload) {
+				As.StoreImm(base, disp, (int)payload, true);
+			}
+			else {
+				As.MovImm64(RCX, payload);
+				As.Store64(base, disp, RCX);
+			}
+			As.StoreImm(base, disp + TypeOffset, (int)type, false);
+		}
+		void PushConst(size_t pc, Variant::DataType type, unsigned long long payload) {
+			StackReserve(1, Slow(pc));
+			StoreConst(RAX, 0, type, payload);
+			As.IncDec64(0, R12, 0);
+		}
+		void GuardArg(size_t i, Label& slow) {
+			As.AluImm(7, RBP, (int)i, true);
+			As.Jcc(CondBE, slow);
+		}
+		// 寄存器形式指令的操作数
+		std::pair<Reg, int> Register(Imm1 r, Label& slow) {
+			if (r & 0x80) {
+				GuardArg(r & 0x7f, slow);
+				return { R15, (r & 0x7f) * (int)sizeof(Variant) };
+			}
+			return { R14, r * (int)sizeof(Variant) };
+		}
+		void GuardInt(std::pair<Reg, int> v, Label& slow) {
+			As.AluMemImm(7, v.first, v.second + TypeOffset, IntType, false);
+			As.Jcc(CondNE, slow);
+		}
+		/// <summary>
+		/// 比较指令对应的条件码，不是比较指令时返回 false，调用者应放弃编译
+		/// </summary>
+		static bool CondOf(Opcode cmp, Cond& cond) {
+			switch (cmp) {
+			case OP_Equ:
+				cond = CondE;
+				return true;
+			case OP_Neq:
+				cond = CondNE;
+				return true;
+			case OP_Gt:
+				cond = CondG;
+				return true;
+			case OP_Ge:
+				cond = CondGE;
+				return true;
+			case OP_Lt:
+				cond = CondL;
+				return true;
+			case OP_Le:
+				cond = CondLE;
+				return true;
+			default:
+				return false;
+			}
+		}
+		bool EmitBinary(size_t pc, Opcode op) {
+			Cond cond{};
+			if (op != OP_Add && op != OP_Sub && op != OP_Mul && !CondOf(op, cond))
+				return false;
+			auto& slow = Slow(pc);
+			StackTop();
+			GuardInt({ RAX, -32 }, slow);
+			GuardInt({ RAX, -16 }, slow);
+			As.Load32(RCX, RAX, -32);
+			if (op == OP_Add)
+				As.Alu32(0x03, RCX, RAX, -16);
+			else if (op == OP_Sub)
+				As.Alu32(0x2B, RCX, RAX, -16);
+			else if (op == OP_Mul)
+				As.Imul32(RCX, RAX, -16);
+			else {
+				As.Alu32(0x3B, RCX, RAX, -16);
+				As.Setcc(cond, RCX);
+			}
+			As.Store32(RAX, -32, RCX);
+			As.IncDec64(1, R12, 0);
+			return true;
+		}
+		void EmitRegisterBinary(size_t pc, Opcode op) {
+			auto& slow = Slow(pc);
+			auto d = Register(Operand<Imm1>(pc, 0), slow);
+			auto a = Register(Operand<Imm1>(pc, 1), slow);
+			auto b = Register(Operand<Imm1>(pc, 2), slow);
+			GuardInt(a, slow);
+			GuardInt(b, slow);
+			As.Load32(RCX, a.first, a.second);
+			if (op == OP_RAdd)
+				As.Alu32(0x03, RCX, b.first, b.second);
+			else if (op == OP_RSub)
+				As.Alu32(0x2B, RCX, b.first, b.second);
+			else
+				As.Imul32(RCX, b.first, b.second);
+			As.Store32(d.first, d.second, RCX);
+			As.StoreImm(d.first, d.second + TypeOffset, IntType, false);
+		}
+		/// <summary>
+		/// OP_Call：被调用者是已编译的脚本函数时，按解释器的 OP_Call 建立栈帧后直接调用本机代码，
+		/// 其余情况(未编译、原生函数、参数或栈空间不足)交给 Call
+		/// </summary>
+		void EmitCall(size_t pc) {
+			if (Rt.FunctionCount > INT_MAX) {
+				CallHelper(Rt.Call, pc);
+				CheckStatus();
+				return;
+			}
+			auto count = (int)(unsigned char)Operand<Imm1>(pc);
+			Slows.push_back({ {}, pc, Next(pc), (size_t)-1, Rt.Call });
+			auto& slow = Slows.back().Entry;
+			StackTop();
+			// 被调用者与参数都在当前栈帧中，且弹出被调用者后还能压入三个帧链接
+			As.Mov(RCX, RAX);
+			As.Sub(RCX, R14);
+			As.AluImm(7, RCX, (count + 1) * (int)sizeof(Variant), true);
+			As.Jcc(CondB, slow);
+			As.AluMemImm(7, R12, 0, (int)(Rt.Stack->max - 1), true);
+			As.Jcc(CondAE, slow);
+			As.AluMemImm(7, RAX, -16 + TypeOffset, FuncPCType, false);
+			As.Jcc(CondNE, slow);
+			// R11 = Functions[入口]
+			As.Load64(RCX, RAX, -16);
+			As.AluImm(7, RCX, (int)Rt.FunctionCount, true);
+			As.Jcc(CondAE, slow);
+			As.Shift(4, RCX, 3);
+			As.MovImm64(RDX, (unsigned long long)Rt.Functions);
+			As.Add(RCX, RDX);
+			As.Load64(R11, RCX, 0);
+			As.AluImm(7, R11, 0, true);
+			As.Jcc(CondE, slow);
+			// 被调用者的位置依次放入 bp、bp2 与返回地址
+			As.MovImm64(RCX, (unsigned long long)&Rt.Stack->bp);
+			As.Load64(RDX, RCX, 0);
+			As.Store64(RAX, -16, RDX);
+			As.StoreImm(RAX, -16 + TypeOffset, (int)Variant::DataType::Ptr, false);
+			As.MovImm64(RCX, (unsigned long long)&Rt.Stack->bp2);
+			As.Load64(RDX, RCX, 0);
+			As.Store64(RAX, 0, RDX);
+			As.StoreImm(RAX, TypeOffset, (int)Variant::DataType::Ptr, false);
+			StoreConst(RAX, 16, Variant::DataType::ReturnPC, Next(pc));
+			// bp = sp - 1 - count，sp += 2，bp2 = sp
+			As.Load64(RDX, R12, 0);
+			As.Mov(RCX, RDX);
+			As.AluImm(5, RCX, count + 1, true);
+			As.MovImm64(R8, (unsigned long long)&Rt.Stack->bp);
+			As.Store64(R8, 0, RCX);
+			As.AluImm(0, RDX, 2, true);
+			As.Store64(R12, 0, RDX);
+			As.MovImm64(R8, (unsigned long long)&Rt.Stack->bp2);
+			As.Store64(R8, 0, RDX);
+			As.Mov(Arg0, RBX);
+			As.Call(R11);
+			// 被调用者返回时已恢复栈帧并压入返回值，R12~R15 由它的尾声恢复
+			As.AluImm(7, RAX, Error, false);
+			As.Jcc(CondE, Exit);
+		}
+		/// <summary>
+		/// OP_Ret/OP_RetNull：与 SimpStack::pop_frame 相同，恢复调用者的栈帧并把返回值放在参数的位置，
+		/// 再把返回地址写入解释器的 PC。载入的字节码经过栈深度检查，帧链接不会被覆盖，这里只检查返回地址的类型
+		/// </summary>
+		void EmitReturn(size_t pc, Opcode op) {
+			auto& slow = Slow(pc);
+			As.AluMemImm(7, R14, -16 + TypeOffset, ReturnPCType, false);
+			As.Jcc(CondNE, slow);
+			// 先取出帧链接，返回值可能覆盖它们
+			As.Load64(R8, R14, -16);
+			As.Load64(R9, R14, -32);
+			As.Load64(R10, R14, -48);
+			if (op == OP_Ret) {
+				StackTop();
+				As.Copy16(R15, 0, RAX, -16);
+			}
+			else {
+				StoreConst(R15, 0, Variant::DataType::Null, 0);
+			}
+			// sp = bp + 1
+			As.Mov(RAX, R15);
+			As.Sub(RAX, R13);
+			As.Shift(5, RAX, 4);
+			As.AluImm(0, RAX, 1, true);
+			As.Store64(R12, 0, RAX);
+			As.MovImm64(RAX, (unsigned long long)&Rt.Stack->bp);
+			As.Store64(RAX, 0, R10);
+			As.MovImm64(RAX, (unsigned long long)&Rt.Stack->bp2);
+			As.Store64(RAX, 0, R9);
+			As.MovImm64(RAX, (unsigned long long)Rt.PC);
+			As.Store64(RAX, 0, R8);
+			As.MovImm32(RAX, Return);
+			As.Jmp(Exit);
+		}
+		/// <summary>
+		/// 翻译一条指令
+		/// </summary>
+		bool EmitInstr(size_t pc) {
+			// 特化指令按通用指令翻译，慢速路径执行的仍是当时的字节码
+			auto op = GetGenericOpcode(static_cast<Opcode>(Bytes[pc]));
+			switch (op) {
+			case OP_Nop:
+				break;
+			case OP_PushI4_0:
+				PushConst(pc, Variant::DataType::Int, 0);
+				break;
+			case OP_PushI4_1:
+				PushConst(pc, Variant::DataType::Int, 1);
+				break;
+			case OP_PushI4:
+				PushConst(pc, Variant::DataType::Int, (unsigned long long)(long long)Operand<Imm4>(pc));
+				break;
+			case OP_PushI8:
+				PushConst(pc, Variant::DataType::Long, Operand<Imm8>(pc));
+				break;
+			case OP_PushFP4:
+				PushConst(pc, Variant::DataType::Float, Operand<UImm4>(pc));
+				break;
+			case OP_PushFP8:
+				PushConst(pc, Variant::DataType::Double, Operand<unsigned long long>(pc));
+				break;
+			case OP_PushNull:
+				PushConst(pc, Variant::DataType::Null, 0);
+				break;
+			case OP_PushFuncPtr:
+				PushConst(pc, Variant::DataType::FuncPC, Operand<UImm4>(pc));
+				break;
+			case OP_PushLocalI1:
+			case OP_PushLocalI4: {
+				size_t i = op == OP_PushLocalI1 ? Operand<Imm1>(pc) : Operand<UImm4>(pc);
+				if (i >= INT_MAX / sizeof(Variant))
+					return false;
+				StackReserve(1, Slow(pc));
+				As.Copy16(RAX, 0, R14, (int)(i * sizeof(Variant)));
+				As.IncDec64(0, R12, 0);
+			} break;
+			case OP_StoreLocalI1:
+			case OP_StoreLocalI4: {
+				size_t i = op == OP_StoreLocalI1 ? Operand<Imm1>(pc) : Operand<UImm4>(pc);
+				if (i >= INT_MAX / sizeof(Variant))
+					return false;
+				StackTop();
+				As.Copy16(R14, (int)(i * sizeof(Variant)), RAX, -16);
+			} break;
+			case OP_PushArg: {
+				auto i = Operand<Imm1>(pc);
+				auto& slow = Slow(pc);
+				GuardArg(i, slow);
+				StackReserve(1, slow);
+				As.Copy16(RAX, 0, R15, i * (int)sizeof(Variant));
+				As.IncDec64(0, R12, 0);
+			} break;
+			case OP_StoreArg: {
+				auto i = Operand<Imm1>(pc);
+				GuardArg(i, Slow(pc));
+				StackTop();
+				As.Copy16(R15, i * (int)sizeof(Variant), RAX, -16);
+			} break;
+			case OP_Dup:
+				StackReserve(1, Slow(pc));
+				As.Copy16(RAX, 0, RAX, -16);
+				As.IncDec64(0, R12, 0);
+				break;
+			case OP_Pop:
+				As.IncDec64(1, R12, 0);
+				break;
+			case OP_Popn:
+				As.AluMemImm(5, R12, 0, Operand<Imm1>(pc), true);
+				break;
+			case OP_PushN:
+			case OP_PushNI4: {
+				size_t n = op == OP_PushN ? Operand<Imm1>(pc) : Operand<UImm4>(pc);
+				if (n == 0)
+					break;
+				// 很大的栈帧逐个展开没有意义
+				if (n > 0xff) {
+					CallHelper(Rt.Step, pc);
+					CheckStatus();
+					break;
+				}
+				StackReserve((int)n, Slow(pc));
+				for (int i = 0; i < (int)n; i++)
+					StoreConst(RAX, i * (int)sizeof(Variant), Variant::DataType::Null, 0);
+				As.AluMemImm(0, R12, 0, (int)n, true);
+			} break;
+			case OP_Add:
+			case OP_Sub:
+			case OP_Mul:
+			case OP_Equ:
+			case OP_Neq:
+			case OP_Gt:
+			case OP_Ge:
+			case OP_Lt:
+			case OP_Le:
+				return EmitBinary(pc, op);
+			case OP_Inc:
+			case OP_Dec: {
+				auto& slow = Slow(pc);
+				StackTop();
+				GuardInt({ RAX, -16 }, slow);
+				As.AluMemImm(op == OP_Inc ? 0 : 5, RAX, -16, 1, false);
+			} break;
+			case OP_Jmp:
+				As.Jmp(Labels.at(Target(pc)));
+				break;
+			case OP_MoveNext:
+				// 迭代总是交给解释器，由返回值决定是否跳转
+				As.Jmp(Slow(pc, Target(pc)));
+				break;
+			case OP_Jz:
+			case OP_Jnz: {
+				auto& target = Labels.at(Target(pc));
+				auto& slow = Slow(pc, Target(pc));
+				StackTop();
+				GuardInt({ RAX, -16 }, slow);
+				As.IncDec64(1, R12, 0);
+				As.AluMemImm(7, RAX, -16, 0, false);
+				// Jz 在值为真时跳转，Jnz 在值为假时跳转
+				As.Jcc(op == OP_Jz ? CondNE : CondE, target);
+			} break;
+			case OP_RMov: {
+				auto& slow = Slow(pc);
+				auto d = Register(Operand<Imm1>(pc, 0), slow);
+				auto s = Register(Operand<Imm1>(pc, 1), slow);
+				As.Copy16(d.first, d.second, s.first, s.second);
+			} break;
+			case OP_RLoadI: {
+				auto d = Register(Operand<Imm1>(pc, 0), Slow(pc));
+				StoreConst(d.first, d.second, Variant::DataType::Int, (unsigned long long)(long long)Operand<Imm4>(pc, 1));
+			} break;
+			case OP_RAdd:
+			case OP_RSub:
+			case OP_RMul:
+				EmitRegisterBinary(pc, op);
+				break;
+			case OP_RAddI: {
+				auto& slow = Slow(pc);
+				auto d = Register(Operand<Imm1>(pc, 0), slow);
+				auto a = Register(Operand<Imm1>(pc, 1), slow);
+				GuardInt(a, slow);
+				As.Load32(RCX, a.first, a.second);
+				As.AluImm(0, RCX, Operand<Imm4>(pc, 2), false);
+				As.Store32(d.first, d.second, RCX);
+				As.StoreImm(d.first, d.second + TypeOffset, IntType, false);
+			} break;
+			case OP_RCmpJnz:
+			case OP_RCmpIJnz: {
+				Cond cond;
+				if (!CondOf(static_cast<Opcode>(Operand<Imm1>(pc, 0)), cond))
+					return false;
+				auto& target = Labels.at(Target(pc));
+				auto& slow = Slow(pc, Target(pc));
+				auto a = Register(Operand<Imm1>(pc, 1), slow);
+				GuardInt(a, slow);
+				if (op == OP_RCmpJnz) {
+					auto b = Register(Operand<Imm1>(pc, 2), slow);
+					GuardInt(b, slow);
+					As.Load32(RCX, a.first, a.second);
+					As.Alu32(0x3B, RCX, b.first, b.second);
+				}
+				else {
+					As.AluMemImm(7, a.first, a.second, Operand<Imm4>(pc, 2), false);
+				}
+				// 条件不成立时跳转
+				As.Jcc(static_cast<Cond>(cond ^ 1), target);
+			} break;
+			case OP_Call:
+				EmitCall(pc);
+				break;
+			case OP_Ret:
+			case OP_RetNull:
+				EmitReturn(pc, op);
+				break;
+			case OP_Throw:
+			case OP_Err:
+				CallHelper(Rt.Step, pc);
+				As.Jmp(Exit);
+				break;
+			default:
+				// 其余指令没有快速路径，直接交给解释器
+				CallHelper(Rt.Step, pc);
+				CheckStatus();
+				break;
+			}
+			return true;
+		}
+
+	public:
+		Compiler(std::span<const char> bytes, const Runtime& rt)
+			: Bytes(bytes), Rt(rt) {}
+		/// <summary>
+		/// 编译从 entry 开始的函数
+		/// </summary>
+		/// <returns>函数中有无法编译的指令时返回 false</returns>
+		bool Compile(size_t entry, std::vector<unsigned char>& out) {
+			if (!Discover(entry))
+				return false;
+			// 序言：保存被调用者保存的寄存器，并从解释器的栈帧中取出基址
+			for (auto r : { RBX, RBP, R12, R13, R14, R15 })
+				As.Push(r);
+			As.AluImm(5, RSP, FrameSize, true);
+			As.Mov(RBX, Arg0);
+			As.MovImm64(R12, (unsigned long long)&Rt.Stack->sp);
+			As.MovImm64(R13, (unsigned long long)&Rt.Stack->ptr);
+			As.Load64(R13, R13, 0);
+			As.MovImm64(RAX, (unsigned long long)&Rt.Stack->bp2);
+			As.Load64(R14, RAX, 0);
+			As.Shift(4, R14, 4);
+			As.Add(R14, R13);
+			As.MovImm64(RAX, (unsigned long long)&Rt.Stack->bp);
+			As.Load64(R15, RAX, 0);
+			As.Shift(4, R15, 4);
+			As.Add(R15, R13);
+			// 参数个数 = (bp2 - 3) - bp
+			As.Mov(RBP, R14);
+			As.Sub(RBP, R15);
+			As.Shift(5, RBP, 4);
+			As.AluImm(5, RBP, 3, true);
+			if (Labels.begin()->first != entry)
+				As.Jmp(Labels.at(entry));
+			for (auto it = Labels.begin(); it != Labels.end(); ++it) {
+				auto pc = it->first;
+				As.Bind(it->second);
+				if (!EmitInstr(pc))
+					return false;
+				auto op = GetGenericOpcode(static_cast<Opcode>(Bytes[pc]));
+				auto next = std::next(it);
+				// 下一条可达指令不紧跟在后面时显式跳转
+				if (!IsTerminator(op) && (next == Labels.end() || next->first != Next(pc)))
+					As.Jmp(Labels.at(Next(pc)));
+			}
+			// 慢速路径放在函数末尾，不打断快速路径
+			for (auto& s : Slows) {
+				As.Bind(s.Entry);
+				CallHelper(s.Helper, s.PC);
+				if (s.Target != (size_t)-1) {
+					As.AluImm(7, RAX, Taken, false);
+					As.Jcc(CondE, Labels.at(s.Target));
+				}
+				CheckStatus();
+				// 返回指令的慢速路径总是离开本机函数，后面可能没有指令
+				auto next = Labels.find(s.Next);
+				As.Jmp(next != Labels.end() ? next->second : Exit);
+			}
+			As.Bind(Exit);
+			As.AluImm(0, RSP, FrameSize, true);
+			for (auto r : { R15, R14, R13, R12, RBP, RBX })
+				As.Pop(r);
+			As.Ret();
+			out = std::move(As.Code);
+			return true;
+		}
+	};
+}
+#endif
 namespace ir {
 	class Interpreter {
 	public:
 		Interpreter(const std::vector<char>& bytes, const std::vector<std::string>& strings)
-			: Bytes(bytes), Strings(strings) {}
+			: OwnedBytes(bytes), OwnedStrings(strings), Bytes(OwnedBytes), Strings(OwnedStrings) {}
+		/// <summary>
+		/// 直接执行外部的只读代码(例如 MappedFile 映射的字节码文件)，不复制代码与常量池，
+		/// 多个解释器(可以属于不同的上下文)能共享同一份代码。code 与 strings 必须比解释器存活得久。
+		/// 只读的代码不会被改写为特化指令；Threaded 引擎仍会为每个解释器建立处理例程表，只需共享代码时可以使用 Switch
+		/// </summary>
+		Interpreter(std::span<const char> code, std::span<const std::string> strings)
+			: Bytes(code), Strings(strings), ReadOnly(true) {
+			// 特化指令的类型检查失败时需要改写回通用指令，只读的代码中不能出现
+			for (size_t pc = 0; pc < Bytes.size(); pc += 1 + GetOperandSize(static_cast<Opcode>(Bytes[pc]))) {
+				auto op = static_cast<Opcode>(Bytes[pc]);
+				if (GetGenericOpcode(op) != op)
+					throw std::runtime_error("Read-only code must not contain specialized instructions.");
+			}
+		}
+		// Bytes 可能指向自身的 OwnedBytes
+		Interpreter(const Interpreter&) = delete;
+		Interpreter& operator=(const Interpreter&) = delete;
+		/// <summary>
+		/// 指令分派方式
+		/// </summary>
+		enum class Engine {
+			// 每条指令都经过中心 switch 分派
+			Switch,
+			// 预解码为处理例程地址表，直接跳转到下一条指令的处理例程(computed goto)
+			// MSVC 不支持取标签地址(NZ_COMPUTED_GOTO 为 0)，此时按 Switch 执行；GCC 下实测也没有明显优势，因此不作为默认值
+			Threaded,
+		};
+		Engine Mode = Engine::Switch;
+		/// <summary>
+		/// 是否把热点函数编译为本机代码(仅 x86-64)，默认关闭，需要时显式开启
+		/// </summary>
+		bool JitEnabled = false;
+		/// <summary>
+		/// 函数被调用多少次后编译
+		/// </summary>
+		size_t JitThreshold = 16;
 		Variant Run(ScriptContext& ctx) {
 			PC = 0;
+			if (CtxId != ctx.Id)
+				Literals.assign(Strings.size(), {});
+			Ctx = &ctx;
+			CtxId = ctx.Id;
+			// 运行期间栈上的值(本地变量、参数、临时值)是 GC 的根
+			struct RootGuard {
+				GC& gc;
+				GCRootSource* src;
+				~RootGuard() {
+					gc.RemoveRootSource(src);
+				}
+			} guard{ ctx.gc, &Stack };
+			ctx.gc.AddRootSource(&Stack);
+			return Execute(ctx, (size_t)-1);
+		}
+		/// <summary>
+		/// 已编译为本机代码的函数个数
+		/// </summary>
+		size_t GetJitCompiledCount() const {
+			size_t n = 0;
+			for (auto& [entry, fn] : JitFunctions)
+				n += fn.Code != nullptr;
+			return n;
+		}
+
+	private:
+		enum class Dispatch {
+			Switch,
+			Threaded,
+			// 只执行一条指令，供本机代码的慢速路径使用
+			Step,
+		};
+		/// <summary>
+		/// 按 Mode 从当前 PC 开始执行，直到 exitFrame 对应的栈帧返回
+		/// </summary>
+		Variant Execute(ScriptContext& ctx, size_t exitFrame) {
+#if NZ_COMPUTED_GOTO
+			if (Mode == Engine::Threaded)
+				return Execute<Dispatch::Threaded>(ctx, exitFrame);
+#endif
+			return Execute<Dispatch::Switch>(ctx, exitFrame);
+		}
+#if NZ_COMPUTED_GOTO
+#define NZ_OP(x) \
+	case x:      \
+	L_##x
+#define NZ_NEXT()                             \
+	if constexpr (D == Dispatch::Threaded) {  \
+		goto* Handlers[PC++];                 \
+	}                                         \
+	else if constexpr (D == Dispatch::Step) { \
+		return {};                            \
+	}                                         \
+	else {                                    \
+		break;                                \
+	}
+#define NZ_LABEL(x) labels[x] = &&L_##x
+#else
+#define NZ_OP(x) case x
+#define NZ_NEXT()                       \
+	if constexpr (D == Dispatch::Step) { \
+		return {};                      \
+	}                                   \
+	else {                              \
+		break;                          \
+	}
+#endif
+// 特化指令的类型检查失败：改回 at 处的通用指令并重新执行
+#define NZ_DEOPT(at)                               \
+	{                                              \
+		PC = at;                                   \
+		Deoptimize(PC);                            \
+		if constexpr (D == Dispatch::Step) {       \
+			return Execute<D>(ctx, exitFrame);     \
+		}                                          \
+		NZ_NEXT();                                 \
+	}
+#define NZ_QUICK_BINOP(x, type, expr)                                                \
+	NZ_OP(x) : {                                                                     \
+		if (Stack.sp < 2 || Stack[Stack.sp - 2].Type != Variant::DataType::type ||  \
+			Stack[Stack.sp - 1].Type != Variant::DataType::type)                     \
+			NZ_DEOPT(PC - 1);                                                        \
+		auto& lft = Stack[Stack.sp - 2];                                             \
+		auto& rht = Stack[Stack.sp - 1];                                             \
+		lft = Variant{ expr };                                                       \
+		Stack.pop();                                                                 \
+	}                                                                                \
+	NZ_NEXT()
+#define NZ_QUICK_REGOP(x, op)                                                                     \
+	NZ_OP(x) : {                                                                                  \
+		auto at = PC - 1;                                                                         \
+		auto dst = Read<Imm1>(Bytes, PC);                                                         \
+		auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));                                           \
+		auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));                                           \
+		if (a.Type != Variant::DataType::Int || b.Type != Variant::DataType::Int)                 \
+			NZ_DEOPT(at);                                                                         \
+		Stack.get_reg(dst) = Variant{ (int)((unsigned int)a.Int op(unsigned int) b.Int) };        \
+	}                                                                                             \
+	NZ_NEXT()
+		template <Dispatch D>
+		Variant Execute(ScriptContext& ctx, size_t exitFrame) {
+			Opcode opc;
+#if NZ_COMPUTED_GOTO
+			if constexpr (D == Dispatch::Threaded) {
+				if (Handlers.size() != Bytes.size() + 1) {
+					const void* labels[256];
+					std::fill(std::begin(labels), std::end(labels), &&L_Invalid);
+					NZ_LABEL(OP_Add);
+					NZ_LABEL(OP_Sub);
+					NZ_LABEL(OP_Div);
+					NZ_LABEL(OP_Mul);
+					NZ_LABEL(OP_Or);
+					NZ_LABEL(OP_And);
+					NZ_LABEL(OP_Band);
+					NZ_LABEL(OP_Bor);
+					NZ_LABEL(OP_Xor);
+					NZ_LABEL(OP_Dup);
+					NZ_LABEL(OP_GetProp);
+					NZ_LABEL(OP_SetProp);
+					NZ_LABEL(OP_GetIndex);
+					NZ_LABEL(OP_SetIndex);
+					NZ_LABEL(OP_Int32);
+					NZ_LABEL(OP_Int64);
+					NZ_LABEL(OP_Float);
+					NZ_LABEL(OP_Double);
+					NZ_LABEL(OP_String);
+					NZ_LABEL(OP_Ret);
+					NZ_LABEL(OP_RetNull);
+					NZ_LABEL(OP_Brk);
+					NZ_LABEL(OP_Err);
+					NZ_LABEL(OP_Call);
+					NZ_LABEL(OP_PushI4_0);
+					NZ_LABEL(OP_PushI4_1);
+					NZ_LABEL(OP_PushFuncPtr);
+					NZ_LABEL(OP_PushI4);
+					NZ_LABEL(OP_PushI8);
+					NZ_LABEL(OP_PushFP4);
+					NZ_LABEL(OP_PushFP8);
+					NZ_LABEL(OP_PushStr);
+					NZ_LABEL(OP_PushNull);
+					NZ_LABEL(OP_PushGlobalVar);
+					NZ_LABEL(OP_StoreGlobalVar);
+					NZ_LABEL(OP_PushGlobal);
+					NZ_LABEL(OP_StoreGlobal);
+					NZ_LABEL(OP_Range);
+					NZ_LABEL(OP_BeginFor);
+					NZ_LABEL(OP_MoveNext);
+					NZ_LABEL(OP_PushArg);
+					NZ_LABEL(OP_StoreArg);
+					NZ_LABEL(OP_PushLocalI1);
+					NZ_LABEL(OP_PushLocalI4);
+					NZ_LABEL(OP_StoreLocalI1);
+					NZ_LABEL(OP_StoreLocalI4);
+					NZ_LABEL(OP_Pop);
+					NZ_LABEL(OP_Popn);
+					NZ_LABEL(OP_PushN);
+					NZ_LABEL(OP_PushNI4);
+					NZ_LABEL(OP_Neg);
+					NZ_LABEL(OP_Not);
+					NZ_LABEL(OP_Bnot);
+					NZ_LABEL(OP_Inc);
+					NZ_LABEL(OP_Dec);
+					NZ_LABEL(OP_Equ);
+					NZ_LABEL(OP_Neq);
+					NZ_LABEL(OP_Gt);
+					NZ_LABEL(OP_Ge);
+					NZ_LABEL(OP_Lt);
+					NZ_LABEL(OP_Le);
+					NZ_LABEL(OP_Jmp);
+					NZ_LABEL(OP_Jz);
+					NZ_LABEL(OP_Jnz);
+					NZ_LABEL(OP_Nop);
+					NZ_LABEL(OP_Throw);
+					NZ_LABEL(OP_RMov);
+					NZ_LABEL(OP_RLoadI);
+					NZ_LABEL(OP_RAdd);
+					NZ_LABEL(OP_RSub);
+					NZ_LABEL(OP_RMul);
+					NZ_LABEL(OP_RDiv);
+					NZ_LABEL(OP_RAddI);
+					NZ_LABEL(OP_RCmpJnz);
+					NZ_LABEL(OP_RCmpIJnz);
+					NZ_LABEL(OP_Add_II);
+					NZ_LABEL(OP_Sub_II);
+					NZ_LABEL(OP_Mul_II);
+					NZ_LABEL(OP_Equ_II);
+					NZ_LABEL(OP_Neq_II);
+					NZ_LABEL(OP_Gt_II);
+					NZ_LABEL(OP_Ge_II);
+					NZ_LABEL(OP_Lt_II);
+					NZ_LABEL(OP_Le_II);
+					NZ_LABEL(OP_Add_DD);
+					NZ_LABEL(OP_Sub_DD);
+					NZ_LABEL(OP_Mul_DD);
+					NZ_LABEL(OP_Div_DD);
+					NZ_LABEL(OP_Gt_DD);
+					NZ_LABEL(OP_Ge_DD);
+					NZ_LABEL(OP_Lt_DD);
+					NZ_LABEL(OP_Le_DD);
+					NZ_LABEL(OP_RAdd_II);
+					NZ_LABEL(OP_RSub_II);
+					NZ_LABEL(OP_RMul_II);
+					NZ_LABEL(OP_RAddI_I);
+					NZ_LABEL(OP_RCmpJnz_II);
+					NZ_LABEL(OP_RCmpIJnz_I);
+					Predecode(labels, &&L_Invalid, &&L_End);
+				}
+				// 跳转表末尾是哨兵，执行到代码末尾时不再需要逐条检查 PC
+				goto* Handlers[PC++];
+			}
+#endif
 			while (PC < Bytes.size()) {
 				// auto p = PC;
 				// DecodeAsm(p);
-				auto opc = static_cast<Opcode>(Bytes[PC++]);
+				opc = static_cast<Opcode>(Bytes[PC++]);
 				switch (opc) {
-				case OP_Add:
-					Stack.push(Stack.top() + Stack.top());
-					break;
-				case OP_Sub:
-					Stack.push(Stack.top() - Stack.top());
-					break;
-				case OP_Div:
-					Stack.push(Stack.top() / Stack.top());
-					break;
-				case OP_Mul:
-					Stack.push(Stack.top() * Stack.top());
-					break;
-				case OP_Or:
+				NZ_OP(OP_Add): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Add_II, OP_Add_DD);
+					Stack.push(lft + rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Sub): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Sub_II, OP_Sub_DD);
+					Stack.push(lft - rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Div): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Nop, OP_Div_DD);
+					Stack.push(lft / rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Mul): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Mul_II, OP_Mul_DD);
+					Stack.push(lft * rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Or):
 					Stack.push(Stack.top() || Stack.top());
-					break;
-				case OP_And:
+					NZ_NEXT();
+				NZ_OP(OP_And):
 					Stack.push(Stack.top() && Stack.top());
-					break;
-				case OP_Band:
+					NZ_NEXT();
+				NZ_OP(OP_Band):
 					Stack.push(Stack.top() & Stack.top());
-					break;
-				case OP_Bor:
+					NZ_NEXT();
+				NZ_OP(OP_Bor):
 					Stack.push(Stack.top() | Stack.top());
-					break;
-				case OP_Xor:
+					NZ_NEXT();
+				NZ_OP(OP_Xor):
 					Stack.push(Stack.top() ^ Stack.top());
-					break;
-				case OP_Dup:
+					NZ_NEXT();
+				NZ_OP(OP_Dup):
 					Stack.push(Stack.top_p());
-					break;
-				case OP_GetProp: {
+					NZ_NEXT();
+				NZ_OP(OP_GetProp): {
+					auto& cache = CacheAt(PC - 1);
 					Variant obj = Stack.top();
-					auto str = Strings[Read<UImm4>(Bytes, PC)];
+					auto& str = Strings[Read<UImm4>(Bytes, PC)];
 					if (obj.Type == Variant::DataType::Object) {
 						auto obj2 = obj.Object;
 						if (obj2->GetType() == typeid(ScriptObject)) {
 							auto obj3 = (ScriptObject*)obj2;
-							Stack.push(obj3->Get(str));
+							Stack.push(GetProperty(cache, obj3, str));
 						}
 						else
 							throw std::runtime_error("Left must be object.");
 					}
 					else
 						throw std::runtime_error("Left must be object.");
-				} break;
-				case OP_SetProp: {
+				} NZ_NEXT();
+				NZ_OP(OP_SetProp): {
+					auto& cache = CacheAt(PC - 1);
 					Variant right = Stack.top();
 					Variant obj = Stack.top();
-					auto str = Strings[Read<UImm4>(Bytes, PC)];
+					auto& str = Strings[Read<UImm4>(Bytes, PC)];
 					if (obj.Type == Variant::DataType::Object) {
 						auto obj2 = obj.Object;
 						if (obj2->GetType() == typeid(ScriptObject)) {
 							auto obj3 = (ScriptObject*)obj2;
-							obj3->Set(str, right);
+							SetProperty(cache, obj3, str, right);
 							Stack.push(right);
+							// 可能添加了属性
+							ctx.gc.Poll();
 						}
 						else
 							throw std::runtime_error("Left must be object.");
 					}
 					else
 						throw std::runtime_error("Left must be object.");
-				} break;
-				case OP_GetIndex: {
+				} NZ_NEXT();
+				NZ_OP(OP_GetIndex): {
 					Variant index = Stack.top();
 					Variant obj = Stack.top();
-					if (obj.Type == Variant::DataType::Object) {
-						Stack.push(((ScriptArray*)obj.Object)->Get(script_cast<long long>(index)));
-					}
-					else
+					if (obj.Type != Variant::DataType::Object)
 						throw std::runtime_error("Left must be array.");
-				} break;
-				case OP_SetIndex: {
+					// 快速路径：普通数组与 Int 下标
+					if (obj.Object->GetKind() == (unsigned char)ObjectKind::Array && index.Type == Variant::DataType::Int) {
+						auto& elems = ((ScriptArray*)obj.Object)->Variants;
+						if ((unsigned int)index.Int < elems.size())
+							Stack.push(elems[(unsigned int)index.Int]);
+						else
+							Stack.push({});
+						NZ_NEXT();
+					}
+					Stack.push(GetElement(obj.Object, index));
+				} NZ_NEXT();
+				NZ_OP(OP_SetIndex): {
 					Variant index = Stack.top();
 					Variant right = Stack.top();
 					Variant obj = Stack.top();
-					if (obj.Type == Variant::DataType::Object) {
-						((ScriptArray*)obj.Object)->Set(script_cast<long long>(index), right);
-						Stack.push(right);
-					}
-					else
+					if (obj.Type != Variant::DataType::Object)
 						throw std::runtime_error("Left must be array.");
-				} break;
-				case OP_Int32:
+					// 快速路径：普通数组与范围内的 Int 下标
+					if (obj.Object->GetKind() == (unsigned char)ObjectKind::Array && index.Type == Variant::DataType::Int) {
+						auto arr = (ScriptArray*)obj.Object;
+						if ((unsigned int)index.Int < arr->Variants.size()) {
+							arr->Variants[(unsigned int)index.Int] = right;
+							if (right.IsGCObject())
+								arr->WriteBarrier(right.Object);
+							Stack.push(right);
+							NZ_NEXT();
+						}
+					}
+					SetElement(obj.Object, index, right);
+					Stack.push(right);
+					// 数组可能扩容
+					ctx.gc.Poll();
+				} NZ_NEXT();
+				NZ_OP(OP_Int32):
 					Stack.push(script_cast<Imm4>(Stack.top()));
-					break;
-				case OP_Int64:
+					NZ_NEXT();
+				NZ_OP(OP_Int64):
 					Stack.push(script_cast<Imm8>(Stack.top()));
-					break;
-				case OP_Float:
+					NZ_NEXT();
+				NZ_OP(OP_Float):
 					Stack.push(script_cast<float>(Stack.top()));
-					break;
-				case OP_Double:
+					NZ_NEXT();
+				NZ_OP(OP_Double):
 					Stack.push(script_cast<double>(Stack.top()));
-					break;
-				case OP_String:
-					Stack.push({ ctx.gc, Strings[script_cast<int>(Stack.top())].c_str() });
-					break;
-				case OP_Ret: {
+					NZ_NEXT();
+				NZ_OP(OP_String): {
+					// 下标来自栈上的值，载入的字节码不能静态检查
+					auto i = (unsigned int)script_cast<int>(Stack.top());
+					if (i >= Strings.size())
+						throw std::runtime_error("Invalid string index.");
+					Stack.push(Literal(ctx, i));
+					ctx.gc.Poll();
+				} NZ_NEXT();
+				NZ_OP(OP_Ret): {
 					auto v = Stack.top();
 					if (!Stack.can_pop_frame())
 						return v;
+					auto frame = Stack.bp2;
 					PC = Stack.pop_frame();
 					Stack.push(v);
-				} break;
-				case OP_RetNull: {
+					if (frame == exitFrame)
+						return v;
+				} NZ_NEXT();
+				NZ_OP(OP_RetNull): {
 					if (!Stack.can_pop_frame())
 						return {};
+					auto frame = Stack.bp2;
 					PC = Stack.pop_frame();
 					Stack.push({});
-				} break;
-				case OP_Brk:
+					if (frame == exitFrame)
+						return {};
+				} NZ_NEXT();
+				NZ_OP(OP_Brk):
 					return {};
-				case OP_Err:
+				NZ_OP(OP_Err):
 					throw std::runtime_error("Soft break");
-				case OP_Call: {
+				NZ_OP(OP_Call): {
 					auto count = Read<Imm1>(Bytes, PC);
 					auto left = Stack.top();
 					if (left.Type == Variant::DataType::Null)
 						throw std::exception("Call on a null object.");
+					// 参数只能取自当前帧，不能越过帧链接
+					if (count > Stack.size() - Stack.bp2)
+						throw std::runtime_error("Invalid operation. (Not enough arguments on the stack)");
 					if (left.Type == Variant::DataType::InternMethod) {
 						std::vector<Variant> variants;
 						variants.resize(count);
 						auto sz = Stack.size() - count;
 						std::copy(Stack.begin() + (sz), Stack.end(), variants.begin());
+						// 参数留在栈上直到调用结束，调用期间发生回收时它们仍然是根
+						auto ret = left.InternMethod(ctx, variants);
 						Stack.reset(sz);
-						Stack.push(left.InternMethod(ctx, variants));
-						break;
+						Stack.push(ret);
+						// 安全点：可能分配内存的指令完成后，所有存活的值都在栈上
+						ctx.gc.Poll();
+						NZ_NEXT();
+					}
+					if (left.Type == Variant::DataType::NativeMethod) {
+						// 参数直接取自栈上，不复制也不分配；调用期间它们仍然是根
+						auto sz = Stack.size() - count;
+						auto ret = left.Native->Call(ctx, Stack.ptr + sz, count);
+						Stack.reset(sz);
+						Stack.push(ret);
+						ctx.gc.Poll();
+						NZ_NEXT();
 					}
 					if (left.Type == Variant::DataType::FuncPC) {
 						auto rbp = Stack.sp - count;
@@ -281,137 +1507,698 @@ namespace ir {
 						Stack.bp2 = Stack.sp;
 
 						PC = left.Pointer;
-						break;
+#if NZ_JIT
+						if constexpr (D != Dispatch::Step) {
+							if (auto fn = JitLookup(PC)) {
+								// 返回时 PC 已被设为返回地址
+								if (fn(this) == JitError)
+									std::rethrow_exception(std::exchange(Pending, nullptr));
+							}
+						}
+#endif
+						NZ_NEXT();
 					}
 					throw std::exception("Left is not Callable.");
-				} break;
-				case OP_PushI4_0:
+				} NZ_NEXT();
+				NZ_OP(OP_PushI4_0):
 					Stack.push(0);
-					break;
-				case OP_PushI4_1:
+					NZ_NEXT();
+				NZ_OP(OP_PushI4_1):
 					Stack.push(1);
-					break;
-				case OP_PushFuncPtr: {
+					NZ_NEXT();
+				NZ_OP(OP_PushFuncPtr): {
 					Variant v{};
 					v.Type = Variant::DataType::FuncPC;
 					v.Pointer = Read<UImm4>(Bytes, PC);
 					Stack.push(v);
-				} break;
-				case OP_PushI4:
+				} NZ_NEXT();
+				NZ_OP(OP_PushI4):
 					Stack.push(Read<Imm4>(Bytes, PC));
-					break;
-				case OP_PushI8:
+					NZ_NEXT();
+				NZ_OP(OP_PushI8):
 					Stack.push(Read<Imm8>(Bytes, PC));
-					break;
-				case OP_PushFP4:
+					NZ_NEXT();
+				NZ_OP(OP_PushFP4):
 					Stack.push(Read<float>(Bytes, PC));
-					break;
-				case OP_PushFP8:
+					NZ_NEXT();
+				NZ_OP(OP_PushFP8):
 					Stack.push(Read<double>(Bytes, PC));
-					break;
-				case OP_PushStr:
-					Stack.push({ ctx.gc, Strings[Read<UImm4>(Bytes, PC)].c_str() });
-					break;
-				case OP_PushNull:
+					NZ_NEXT();
+				NZ_OP(OP_PushStr):
+					Stack.push(Literal(ctx, Read<UImm4>(Bytes, PC)));
+					ctx.gc.Poll();
+					NZ_NEXT();
+				NZ_OP(OP_PushNull):
 					Stack.push({});
-					break;
-				case OP_PushGlobalVar:
+					NZ_NEXT();
+				NZ_OP(OP_PushGlobalVar):
 					Stack.push(ctx.LookupGlobal(Strings[Read<UImm4>(Bytes, PC)]));
-					break;
-				case OP_StoreGlobalVar:
+					NZ_NEXT();
+				NZ_OP(OP_PushGlobal): {
+					auto slot = Read<UImm4>(Bytes, PC);
+					if (slot >= ctx.Globals.size())
+						throw std::runtime_error("Invalid global slot.");
+					Stack.push(ctx.Globals[slot]);
+				} NZ_NEXT();
+				NZ_OP(OP_StoreGlobal): {
+					auto slot = Read<UImm4>(Bytes, PC);
+					if (slot >= ctx.Globals.size())
+						throw std::runtime_error("Invalid global slot.");
+					ctx.Globals[slot] = Stack.top_p();
+				} NZ_NEXT();
+				NZ_OP(OP_Range): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Stack.push(ScriptRange::Create(ctx.gc, lft, rht));
+					ctx.gc.Poll();
+				} NZ_NEXT();
+				NZ_OP(OP_BeginFor): {
+					auto v = Stack.top();
+					Stack.push(BeginIteration(ctx, v));
+					ctx.gc.Poll();
+				} NZ_NEXT();
+				NZ_OP(OP_MoveNext): {
+					auto exit = Read<Imm4>(Bytes, PC);
+					// 下标由编译器生成，总是从 0 开始递增的 Int
+					auto index = Stack.top();
+					auto src = Stack.top();
+					Variant item;
+					if (NextElement(src.Object, (size_t)(unsigned int)index.Int, item))
+						Stack.push(item);
+					else
+						PC += exit;
+				} NZ_NEXT();
+				NZ_OP(OP_StoreGlobalVar):
 					ctx.SetGlobalVar(Strings[Read<UImm4>(Bytes, PC)], Stack.top_p());
-					break;
-				case OP_PushArg:
+					NZ_NEXT();
+				NZ_OP(OP_PushArg):
 					Stack.push(Stack.get_arg(Read<Imm1>(Bytes, PC)));
-					break;
-				case OP_StoreArg:
+					NZ_NEXT();
+				NZ_OP(OP_StoreArg):
 					Stack.get_arg(Read<Imm1>(Bytes, PC)) = Stack.top_p();
-					break;
-				case OP_PushLocalI1:
+					NZ_NEXT();
+				NZ_OP(OP_PushLocalI1):
 					Stack.push(Stack.get_local(Read<Imm1>(Bytes, PC)));
-					break;
-				case OP_PushLocalI4:
+					NZ_NEXT();
+				NZ_OP(OP_PushLocalI4):
 					Stack.push(Stack.get_local(Read<UImm4>(Bytes, PC)));
-					break;
-				case OP_StoreLocalI1:
+					NZ_NEXT();
+				NZ_OP(OP_StoreLocalI1):
 					Stack.get_local(Read<Imm1>(Bytes, PC)) = Stack.top_p();
-					break;
-				case OP_StoreLocalI4:
+					NZ_NEXT();
+				NZ_OP(OP_StoreLocalI4):
 					Stack.get_local(Read<UImm4>(Bytes, PC)) = Stack.top_p();
-					break;
-				case OP_Pop:
+					NZ_NEXT();
+				NZ_OP(OP_Pop):
 					Stack.pop();
-					break;
-				case OP_Popn: {
+					NZ_NEXT();
+				NZ_OP(OP_Popn): {
 					auto v = Read<Imm1>(Bytes, PC);
 					for (int i = 0; i < v; ++i) {
 						Stack.pop();
 					}
-				} break;
-				case OP_PushN: {
+				} NZ_NEXT();
+				NZ_OP(OP_PushN): {
 					auto v = Read<Imm1>(Bytes, PC);
 					for (int i = 0; i < v; ++i) {
 						Stack.push({});
 					}
-				} break;
-				case OP_Neg:
+				} NZ_NEXT();
+				NZ_OP(OP_PushNI4): {
+					auto v = Read<UImm4>(Bytes, PC);
+					for (UImm4 i = 0; i < v; ++i) {
+						Stack.push({});
+					}
+				} NZ_NEXT();
+				NZ_OP(OP_Neg):
 					Stack.push(-Stack.top());
-					break;
-				case OP_Not:
+					NZ_NEXT();
+				NZ_OP(OP_Not):
 					Stack.push(!Stack.top());
-					break;
-				case OP_Bnot:
+					NZ_NEXT();
+				NZ_OP(OP_Bnot):
 					Stack.push(~Stack.top());
-					break;
-				case OP_Inc:
+					NZ_NEXT();
+				NZ_OP(OP_Inc):
 					Stack.push(Stack.top() + Variant{ 1 });
-					break;
-				case OP_Dec:
+					NZ_NEXT();
+				NZ_OP(OP_Dec):
 					Stack.push(Stack.top() - Variant{ 1 });
-					break;
-				case OP_Equ:
-					Stack.push(Stack.top() == Stack.top());
-					break;
-				case OP_Neq:
-					Stack.push(Stack.top() != Stack.top());
-					break;
-				case OP_Gt:
-					Stack.push(Stack.top() > Stack.top());
-					break;
-				case OP_Ge:
-					Stack.push(Stack.top() >= Stack.top());
-					break;
-				case OP_Lt:
-					Stack.push(Stack.top() < Stack.top());
-					break;
-				case OP_Le:
-					Stack.push(Stack.top() <= Stack.top());
-					break;
-				case OP_Jmp:
+					NZ_NEXT();
+				NZ_OP(OP_Equ): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Equ_II, OP_Nop);
+					Stack.push(lft == rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Neq): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Neq_II, OP_Nop);
+					Stack.push(lft != rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Gt): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Gt_II, OP_Gt_DD);
+					Stack.push(lft > rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Ge): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Ge_II, OP_Ge_DD);
+					Stack.push(lft >= rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Lt): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Lt_II, OP_Lt_DD);
+					Stack.push(lft < rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Le): {
+					auto rht = Stack.top();
+					auto lft = Stack.top();
+					Quicken(PC - 1, lft, rht, OP_Le_II, OP_Le_DD);
+					Stack.push(lft <= rht);
+				} NZ_NEXT();
+				NZ_OP(OP_Jmp):
 					PC += Read<Imm4>(Bytes, PC);
-					break;
-				case OP_Jz: {
+					NZ_NEXT();
+				NZ_OP(OP_Jz): {
 					auto v = Read<Imm4>(Bytes, PC);
 					if (Stack.top()) {
 						PC += v;
 					}
-				} break;
-				case OP_Jnz: {
+				} NZ_NEXT();
+				NZ_OP(OP_Jnz): {
 					auto v = Read<Imm4>(Bytes, PC);
 					if (!Stack.top()) {
 						PC += v;
 					}
-				} break;
-				case OP_Nop:
-					break;
-				case OP_Throw:
+				} NZ_NEXT();
+				NZ_OP(OP_Nop):
+					NZ_NEXT();
+				NZ_OP(OP_Throw):
 					throw std::runtime_error(Stack.top().ToString());
+				NZ_OP(OP_RMov): {
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto src = Read<Imm1>(Bytes, PC);
+					Stack.get_reg(dst) = Stack.get_reg(src);
+				} NZ_NEXT();
+				NZ_OP(OP_RLoadI): {
+					auto dst = Read<Imm1>(Bytes, PC);
+					Stack.get_reg(dst) = Read<Imm4>(Bytes, PC);
+				} NZ_NEXT();
+				NZ_OP(OP_RAdd): {
+					auto at = PC - 1;
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					Quicken(at, a, b, OP_RAdd_II, OP_Nop);
+					Stack.get_reg(dst) = a + b;
+				} NZ_NEXT();
+				NZ_OP(OP_RSub): {
+					auto at = PC - 1;
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					Quicken(at, a, b, OP_RSub_II, OP_Nop);
+					Stack.get_reg(dst) = a - b;
+				} NZ_NEXT();
+				NZ_OP(OP_RMul): {
+					auto at = PC - 1;
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					Quicken(at, a, b, OP_RMul_II, OP_Nop);
+					Stack.get_reg(dst) = a * b;
+				} NZ_NEXT();
+				NZ_OP(OP_RDiv): {
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto a = Read<Imm1>(Bytes, PC);
+					auto b = Read<Imm1>(Bytes, PC);
+					Stack.get_reg(dst) = Stack.get_reg(a) / Stack.get_reg(b);
+				} NZ_NEXT();
+				NZ_OP(OP_RAddI): {
+					auto at = PC - 1;
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					Variant k = Read<Imm4>(Bytes, PC);
+					Quicken(at, a, k, OP_RAddI_I, OP_Nop);
+					Stack.get_reg(dst) = a + k;
+				} NZ_NEXT();
+				NZ_OP(OP_RCmpJnz): {
+					auto at = PC - 1;
+					auto cond = static_cast<Opcode>(Read<Imm1>(Bytes, PC));
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto v = Read<Imm4>(Bytes, PC);
+					Quicken(at, a, b, OP_RCmpJnz_II, OP_Nop);
+					if (!Compare(cond, a, b)) {
+						PC += v;
+					}
+				} NZ_NEXT();
+				NZ_OP(OP_RCmpIJnz): {
+					auto at = PC - 1;
+					auto cond = static_cast<Opcode>(Read<Imm1>(Bytes, PC));
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					Variant k = Read<Imm4>(Bytes, PC);
+					auto v = Read<Imm4>(Bytes, PC);
+					Quicken(at, a, k, OP_RCmpIJnz_I, OP_Nop);
+					if (!Compare(cond, a, k)) {
+						PC += v;
+					}
+				} NZ_NEXT();
+				// 特化指令：先检查类型，不符时改回通用指令并重新执行
+				NZ_QUICK_BINOP(OP_Add_II, Int, (int)((unsigned int)lft.Int + (unsigned int)rht.Int));
+				NZ_QUICK_BINOP(OP_Sub_II, Int, (int)((unsigned int)lft.Int - (unsigned int)rht.Int));
+				NZ_QUICK_BINOP(OP_Mul_II, Int, (int)((unsigned int)lft.Int * (unsigned int)rht.Int));
+				NZ_QUICK_BINOP(OP_Equ_II, Int, lft.Int == rht.Int);
+				NZ_QUICK_BINOP(OP_Neq_II, Int, lft.Int != rht.Int);
+				NZ_QUICK_BINOP(OP_Gt_II, Int, lft.Int > rht.Int);
+				NZ_QUICK_BINOP(OP_Ge_II, Int, lft.Int >= rht.Int);
+				NZ_QUICK_BINOP(OP_Lt_II, Int, lft.Int < rht.Int);
+				NZ_QUICK_BINOP(OP_Le_II, Int, lft.Int <= rht.Int);
+				NZ_QUICK_BINOP(OP_Add_DD, Double, lft.Double + rht.Double);
+				NZ_QUICK_BINOP(OP_Sub_DD, Double, lft.Double - rht.Double);
+				NZ_QUICK_BINOP(OP_Mul_DD, Double, lft.Double * rht.Double);
+				NZ_QUICK_BINOP(OP_Div_DD, Double, lft.Double / rht.Double);
+				NZ_QUICK_BINOP(OP_Gt_DD, Double, lft.Double > rht.Double);
+				NZ_QUICK_BINOP(OP_Ge_DD, Double, lft.Double >= rht.Double);
+				NZ_QUICK_BINOP(OP_Lt_DD, Double, lft.Double < rht.Double);
+				NZ_QUICK_BINOP(OP_Le_DD, Double, lft.Double <= rht.Double);
+				NZ_QUICK_REGOP(OP_RAdd_II, +);
+				NZ_QUICK_REGOP(OP_RSub_II, -);
+				NZ_QUICK_REGOP(OP_RMul_II, *);
+				NZ_OP(OP_RAddI_I): {
+					auto at = PC - 1;
+					auto dst = Read<Imm1>(Bytes, PC);
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto k = Read<Imm4>(Bytes, PC);
+					if (a.Type != Variant::DataType::Int)
+						NZ_DEOPT(at);
+					Stack.get_reg(dst) = Variant{ (int)((unsigned int)a.Int + (unsigned int)k) };
+				} NZ_NEXT();
+				NZ_OP(OP_RCmpJnz_II): {
+					auto at = PC - 1;
+					auto cond = static_cast<Opcode>(Read<Imm1>(Bytes, PC));
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto& b = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto v = Read<Imm4>(Bytes, PC);
+					if (a.Type != Variant::DataType::Int || b.Type != Variant::DataType::Int)
+						NZ_DEOPT(at);
+					if (!CompareInt(cond, a.Int, b.Int)) {
+						PC += v;
+					}
+				} NZ_NEXT();
+				NZ_OP(OP_RCmpIJnz_I): {
+					auto at = PC - 1;
+					auto cond = static_cast<Opcode>(Read<Imm1>(Bytes, PC));
+					auto& a = Stack.get_reg(Read<Imm1>(Bytes, PC));
+					auto k = Read<Imm4>(Bytes, PC);
+					auto v = Read<Imm4>(Bytes, PC);
+					if (a.Type != Variant::DataType::Int)
+						NZ_DEOPT(at);
+					if (!CompareInt(cond, a.Int, k)) {
+						PC += v;
+					}
+				} NZ_NEXT();
 				default:
+#if NZ_COMPUTED_GOTO
+				L_Invalid:
+#endif
 					throw std::runtime_error("Invalid opcode");
 				}
 			}
+#if NZ_COMPUTED_GOTO
+		L_End:
+#endif
 			return {};
 		}
+#undef NZ_OP
+#undef NZ_NEXT
+#undef NZ_LABEL
+#undef NZ_DEOPT
+#undef NZ_QUICK_BINOP
+#undef NZ_QUICK_REGOP
+		/// <summary>
+		/// 特化指令的类型检查在同一处失败这么多次后，不再改写该处的指令
+		/// </summary>
+		static constexpr unsigned char QuickenLimit = 4;
+		/// <summary>
+		/// 操作数类型相同且有对应的特化指令时，把 pc 处的通用指令改写为特化指令
+		/// </summary>
+		void Quicken(size_t pc, const Variant& a, const Variant& b, Opcode ii, Opcode dd) {
+			if (ReadOnly || a.Type != b.Type)
+				return;
+			auto op = a.Type == Variant::DataType::Int ? ii : a.Type == Variant::DataType::Double ? dd
+																								  : OP_Nop;
+			if (op == OP_Nop || (!Deopts.empty() && Deopts[pc] >= QuickenLimit))
+				return;
+			Rewrite(pc, op);
+		}
+		/// <summary>
+		/// 把 pc 处的特化指令改回通用指令
+		/// </summary>
+		void Deoptimize(size_t pc) {
+			if (Deopts.empty())
+				Deopts.resize(Bytes.size());
+			if (Deopts[pc] < QuickenLimit)
+				Deopts[pc]++;
+			Rewrite(pc, GetGenericOpcode(static_cast<Opcode>(Bytes[pc])));
+		}
+		/// <summary>
+		/// 属性访问的内联缓存
+		///
+		/// 每处 GetProp/SetProp 记录见过的形状与对应的槽位：只见过一种形状时是单态的，
+		/// 最多记录 Ways 种(多态)，再多则不再记录(超多态)，之后只查找属性表。
+		/// 共享形状不会改变，所以 (形状, 属性名) 确定槽位；字典模式的形状不缓存。
+		/// SetProp 还会缓存添加属性的转移，命中时不需要查找转移树。
+		/// </summary>
+		struct PropertyCache {
+			static constexpr unsigned char Ways = 4;
+			struct Entry {
+				const Shape* From;
+				// 添加属性后的形状，访问已有属性时为 nullptr
+				Shape* To;
+				// 属性不存在时为 Shape::NotFound(仅 GetProp)
+				size_t Slot;
+			};
+			Entry Entries[Ways];
+			unsigned char Count = 0;
+			bool Megamorphic = false;
+		};
+		/// <summary>
+		/// 以 PC 为下标的内联缓存编号(从 1 开始，0 表示尚未分配)，第一次访问属性时才分配
+		/// </summary>
+		std::vector<unsigned int> CacheIndex;
+		std::deque<PropertyCache> Caches;
+		PropertyCache& CacheAt(size_t pc) {
+			if (CacheIndex.empty())
+				CacheIndex.resize(Bytes.size());
+			auto& index = CacheIndex[pc];
+			if (index == 0) {
+				Caches.emplace_back();
+				index = (unsigned int)Caches.size();
+			}
+			return Caches[index - 1];
+		}
+		void Remember(PropertyCache& cache, const Shape* from, Shape* to, size_t slot) {
+			if (from->Dictionary || cache.Megamorphic)
+				return;
+			if (cache.Count == PropertyCache::Ways) {
+				cache.Megamorphic = true;
+				Stats.MegamorphicSites++;
+				return;
+			}
+			cache.Entries[cache.Count++] = { from, to, slot };
+		}
+		Variant GetProperty(PropertyCache& cache, ScriptObject* obj, const std::string& name) {
+			auto shape = obj->Layout;
+			for (unsigned char i = 0; i < cache.Count; i++) {
+				auto& e = cache.Entries[i];
+				if (e.From == shape) {
+					Stats.PropertyHits++;
+					if (e.Slot == Shape::NotFound)
+						return {};
+					return obj->Slots[e.Slot];
+				}
+			}
+			Stats.PropertyMisses++;
+			auto slot = shape->Find(name);
+			Remember(cache, shape, nullptr, slot);
+			if (slot == Shape::NotFound)
+				return {};
+			return obj->Slots[slot];
+		}
+		void SetProperty(PropertyCache& cache, ScriptObject* obj, const std::string& name, const Variant& v) {
+			auto shape = obj->Layout;
+			for (unsigned char i = 0; i < cache.Count; i++) {
+				auto& e = cache.Entries[i];
+				if (e.From == shape) {
+					Stats.PropertyHits++;
+					if (e.To != nullptr)
+						obj->ApplyTransition(e.To);
+					obj->SetSlot(e.Slot, v);
+					return;
+				}
+			}
+			Stats.PropertyMisses++;
+			auto slot = shape->Find(name);
+			if (slot != Shape::NotFound)
+				Remember(cache, shape, nullptr, slot);
+			else {
+				slot = obj->AddProperty(name);
+				if (!obj->Layout->Dictionary)
+					Remember(cache, shape, obj->Layout, slot);
+			}
+			obj->SetSlot(slot, v);
+		}
+		/// <summary>
+		/// OP_GetIndex 的一般路径：任意数值下标，普通数组或数值数组
+		/// </summary>
+		static Variant GetElement(GCObject* obj, const Variant& index) {
+			auto i = script_cast<long long>(index);
+			Variant ret{};
+			if (VisitTypedArray(obj, [&](auto arr) { ret = arr->Get((size_t)i); }))
+				return ret;
+			if (obj->GetKind() == (unsigned char)ObjectKind::Range)
+				return ((ScriptRange*)obj)->Get((size_t)i);
+			if (obj->GetKind() != (unsigned char)ObjectKind::Array)
+				throw std::runtime_error("Left must be array.");
+			// 负数下标转换后超出范围，同样返回 null
+			return ((ScriptArray*)obj)->Get((size_t)i);
+		}
+		/// <summary>
+		/// OP_BeginFor：取得 foreach 的迭代源
+		/// </summary>
+		static Variant BeginIteration(ScriptContext& ctx, const Variant& v) {
+			if (v.Type != Variant::DataType::Object)
+				throw std::runtime_error("Value is not iterable.");
+			switch ((ObjectKind)v.Object->GetKind()) {
+			case ObjectKind::Array:
+			case ObjectKind::Range:
+			case ObjectKind::Int32Array:
+			case ObjectKind::Int64Array:
+			case ObjectKind::Float64Array:
+				return v;
+			case ObjectKind::Object: {
+				// 遍历开始时的属性名，循环中增删属性不影响本次遍历
+				auto keys = new (ctx.gc) ScriptArray(ctx.gc);
+				for (auto& name : ((ScriptObject*)v.Object)->Layout->Names)
+					keys->Add(ctx.Intern(name));
+				Variant r{};
+				r.Type = Variant::DataType::Object;
+				r.Object = keys;
+				return r;
+			}
+			default:
+				throw std::runtime_error("Value is not iterable.");
+			}
+		}
+		/// <summary>
+		/// OP_MoveNext：取得迭代源的第 i 个元素，没有更多元素时返回 false
+		/// </summary>
+		static bool NextElement(GCObject* src, size_t i, Variant& out) {
+			switch ((ObjectKind)src->GetKind()) {
+			case ObjectKind::Array: {
+				auto& elems = ((ScriptArray*)src)->Variants;
+				if (i >= elems.size())
+					return false;
+				out = elems[i];
+				return true;
+			}
+			case ObjectKind::Range: {
+				auto range = (ScriptRange*)src;
+				if (i >= range->Size())
+					return false;
+				out = range->Get(i);
+				return true;
+			}
+			default: {
+				bool more = false;
+				VisitTypedArray(src, [&](auto arr) {
+					if (i < arr->Data.size()) {
+						out = Variant{ arr->Data[i] };
+						more = true;
+					}
+				});
+				return more;
+			}
+			}
+		}
+		static void SetElement(GCObject* obj, const Variant& index, const Variant& v) {
+			auto i = script_cast<long long>(index);
+			if (VisitTypedArray(obj, [&](auto arr) { arr->Set((size_t)i, v); }))
+				return;
+			if (obj->GetKind() != (unsigned char)ObjectKind::Array)
+				throw std::runtime_error("Left must be array.");
+			if (i < 0)
+				throw std::runtime_error("Index out of range.");
+			((ScriptArray*)obj)->Set((size_t)i, v);
+		}
+		void Rewrite(size_t pc, Opcode op) {
+			// 只读的代码不会被特化，这里总是自有的副本
+			OwnedBytes[pc] = op;
+			// Threaded 引擎已经预解码过时同步更新处理例程
+			if (Handlers.size() == Bytes.size() + 1)
+				Handlers[pc] = Labels[op];
+		}
+		static bool CompareInt(Opcode cond, int a, int b) {
+			switch (cond) {
+			case OP_Equ:
+				return a == b;
+			case OP_Neq:
+				return a != b;
+			case OP_Gt:
+				return a > b;
+			case OP_Ge:
+				return a >= b;
+			case OP_Lt:
+				return a < b;
+			case OP_Le:
+				return a <= b;
+			default:
+				throw std::runtime_error("Invalid compare condition");
+			}
+		}
+		/// <summary>
+		/// 按比较指令比较两个值，用于寄存器形式的条件跳转
+		/// </summary>
+		static bool Compare(Opcode cond, const Variant& a, const Variant& b) {
+			switch (cond) {
+			case OP_Equ:
+				return a == b;
+			case OP_Neq:
+				return a != b;
+			case OP_Gt:
+				return a > b;
+			case OP_Ge:
+				return a >= b;
+			case OP_Lt:
+				return a < b;
+			case OP_Le:
+				return a <= b;
+			default:
+				throw std::runtime_error("Invalid compare condition");
+			}
+		}
+#if NZ_JIT
+		enum JitStatus : int {
+			JitContinue,
+			// 分支指令发生了跳转
+			JitTaken,
+			JitReturn,
+			// 异常保存在 Pending 中
+			JitError,
+		};
+		using JitFunction = int (*)(Interpreter*);
+		struct JitEntry {
+			size_t Calls = 0;
+			bool Failed = false;
+			JitFunction Code = nullptr;
+		};
+		/// <summary>
+		/// 统计函数的调用次数，达到阈值时编译，返回已编译的本机函数
+		/// </summary>
+		JitFunction JitLookup(size_t entry) {
+			if (!JitEnabled)
+				return nullptr;
+			if (entry < JitTable.size() && JitTable[entry] != nullptr)
+				return JitTable[entry];
+			auto& fn = JitFunctions[entry];
+			if (fn.Code != nullptr || fn.Failed || ++fn.Calls < JitThreshold)
+				return fn.Code;
+			// 本机代码直接读取这张表，编译第一个函数前分配，之后不再改变大小
+			if (JitTable.empty())
+				JitTable.resize(Bytes.size());
+			x64::Runtime rt{ &Stack, (const void*)&JitStep, (const void*)&JitCall, (const void* const*)JitTable.data(), JitTable.size(), &PC };
+			std::vector<unsigned char> code;
+			auto mem = std::make_unique<x64::ExecutableMemory>();
+			if (!x64::Compiler(Bytes, rt).Compile(entry, code) || !mem->Commit(code)) {
+				fn.Failed = true;
+				return nullptr;
+			}
+			fn.Code = (JitFunction)mem->Get();
+			if (entry < JitTable.size())
+				JitTable[entry] = fn.Code;
+			JitCode.push_back(std::move(mem));
+			return fn.Code;
+		}
+		/// <summary>
+		/// 执行刚刚建立的栈帧直到它返回，优先使用本机代码
+		/// </summary>
+		void RunFrame() {
+			if (auto fn = JitLookup(PC)) {
+				if (fn(this) == JitError)
+					std::rethrow_exception(std::exchange(Pending, nullptr));
+				return;
+			}
+			Execute(*Ctx, Stack.bp2);
+		}
+		// 以下由本机代码调用，异常不能穿过本机代码，因此全部转为 JitError
+		static int JitStep(Interpreter* self, size_t pc) {
+			try {
+				auto op = static_cast<Opcode>(self->Bytes[pc]);
+				auto next = pc + 1 + GetOperandSize(op);
+				self->PC = pc;
+				self->Execute<Dispatch::Step>(*self->Ctx, (size_t)-1);
+				if (op == OP_Ret || op == OP_RetNull)
+					return JitReturn;
+				return self->PC == next ? JitContinue : JitTaken;
+			}
+			catch (...) {
+				self->Pending = std::current_exception();
+				return JitError;
+			}
+		}
+		static int JitCall(Interpreter* self, size_t pc) {
+			try {
+				auto frame = self->Stack.bp2;
+				self->PC = pc;
+				self->Execute<Dispatch::Step>(*self->Ctx, (size_t)-1);
+				// 调用的是脚本函数时 Step 只建立了栈帧
+				if (self->Stack.bp2 != frame)
+					self->RunFrame();
+				return JitContinue;
+			}
+			catch (...) {
+				self->Pending = std::current_exception();
+				return JitError;
+			}
+		}
+#endif
+		/// <summary>
+		/// 按指令边界把每个操作码翻译成对应处理例程的地址
+		/// </summary>
+		/// <param name="labels">操作码到处理例程的映射</param>
+		/// <param name="invalid">非指令边界处的处理例程</param>
+		/// <param name="end">代码末尾的哨兵</param>
+		void Predecode(const void* const* labels, const void* invalid, const void* end) {
+			std::copy(labels, labels + 256, Labels);
+			Handlers.assign(Bytes.size() + 1, invalid);
+			size_t pc = 0;
+			while (pc < Bytes.size()) {
+				auto opc = static_cast<Opcode>(Bytes[pc]);
+				Handlers[pc] = labels[opc];
+				pc += 1 + GetOperandSize(opc);
+			}
+			Handlers[Bytes.size()] = end;
+		}
+
+	public:
+		/// <summary>
+		/// 内联缓存的统计信息
+		/// </summary>
+		struct CacheStats {
+			size_t PropertyHits = 0;
+			size_t PropertyMisses = 0;
+			// 见过的形状超过 PropertyCache::Ways 种的访问位置数
+			size_t MegamorphicSites = 0;
+		};
+		const CacheStats& GetCacheStats() const {
+			return Stats;
+		}
 		size_t GetPC() {
 			return PC;
 		}
@@ -432,7 +2219,7 @@ namespace ir {
 			auto opc = static_cast<Opcode>(Bytes[PC++]);
 			std::cout << "0x" << std::hex << std::setw(4) << std::setfill('0') << PC - 1 << ":" << std::oct;
 			std::string exdesc;
-			switch (opc) {
+			switch (GetGenericOpcode(opc)) {
 			case OP_PushStr:
 			case OP_PushGlobalVar:
 			case OP_StoreGlobalVar:
@@ -440,11 +2227,17 @@ namespace ir {
 			case OP_SetProp:
 				exdesc = Strings[Read<unsigned int>(Bytes, PC)];
 				break;
+			case OP_PushGlobal:
+			case OP_StoreGlobal: {
+				auto slot = Read<unsigned int>(Bytes, PC);
+				exdesc = Ctx != nullptr && slot < Ctx->GlobalNames.size() ? Ctx->GlobalNames[slot] : "#" + std::to_string(slot);
+			} break;
 			case OP_PushFP4:
 				exdesc = std::to_string(Read<float>(Bytes, PC));
 				break;
 			case OP_PushLocalI4:
 			case OP_StoreLocalI4:
+			case OP_PushNI4:
 			case OP_PushFuncPtr:
 			case OP_PushI4:
 				exdesc = std::to_string(Read<int>(Bytes, PC));
@@ -452,6 +2245,7 @@ namespace ir {
 			case OP_Jmp:
 			case OP_Jz:
 			case OP_Jnz:
+			case OP_MoveNext:
 				exdesc = std::format("0x{:x}", PC + Read<int>(Bytes, PC));
 				break;
 			case OP_PushI8:
@@ -460,7 +2254,47 @@ namespace ir {
 			case OP_PushFP8:
 				exdesc = std::to_string(Read<double>(Bytes, PC));
 				break;
+			case OP_RMov: {
+				auto dst = Read<Imm1>(Bytes, PC);
+				auto src = Read<Imm1>(Bytes, PC);
+				exdesc = std::format("r{}, r{}", dst, src);
+			} break;
+			case OP_RLoadI: {
+				auto dst = Read<Imm1>(Bytes, PC);
+				auto k = Read<Imm4>(Bytes, PC);
+				exdesc = std::format("r{}, {}", dst, k);
+			} break;
+			case OP_RAdd:
+			case OP_RSub:
+			case OP_RMul:
+			case OP_RDiv: {
+				auto dst = Read<Imm1>(Bytes, PC);
+				auto a = Read<Imm1>(Bytes, PC);
+				auto b = Read<Imm1>(Bytes, PC);
+				exdesc = std::format("r{}, r{}, r{}", dst, a, b);
+			} break;
+			case OP_RAddI: {
+				auto dst = Read<Imm1>(Bytes, PC);
+				auto a = Read<Imm1>(Bytes, PC);
+				auto k = Read<Imm4>(Bytes, PC);
+				exdesc = std::format("r{}, r{}, {}", dst, a, k);
+			} break;
+			case OP_RCmpJnz: {
+				auto cond = GetOpCodeAbbr(static_cast<Opcode>(Read<Imm1>(Bytes, PC)));
+				auto a = Read<Imm1>(Bytes, PC);
+				auto b = Read<Imm1>(Bytes, PC);
+				auto off = Read<Imm4>(Bytes, PC);
+				exdesc = std::format("{} r{}, r{}, 0x{:x}", cond, a, b, PC + off);
+			} break;
+			case OP_RCmpIJnz: {
+				auto cond = GetOpCodeAbbr(static_cast<Opcode>(Read<Imm1>(Bytes, PC)));
+				auto a = Read<Imm1>(Bytes, PC);
+				auto k = Read<Imm4>(Bytes, PC);
+				auto off = Read<Imm4>(Bytes, PC);
+				exdesc = std::format("{} r{}, {}, 0x{:x}", cond, a, k, PC + off);
+			} break;
 			case OP_PushArg:
+			case OP_StoreArg:
 			case OP_Call:
 			case OP_Popn:
 			case OP_PushN:
@@ -472,23 +2306,73 @@ namespace ir {
 			auto c = PC - rpc;
 			PrintBuf(&Bytes[rpc], c);
 			char buf[40]{};
-			memset(buf, ' ', 3 * 9 - c * 3);
+			memset(buf, ' ', c < 11 ? 3 * 11 - c * 3 : 1);
 			std::cout << buf;
 			std::cout << ir::GetOpCodeAbbr(opc) << " " << exdesc << "\n";
 		}
 
 	public:
 		template <typename T>
-		static T Read(const std::vector<char>& bytes, size_t& pc) {
+		static T Read(std::span<const char> bytes, size_t& pc) {
 			T value;
 			memcpy(&value, &bytes[pc], sizeof(T));
 			pc += sizeof(T);
 			return value;
 		}
 
-		std::vector<char> Bytes;
-		std::vector<std::string> Strings;
+	private:
+		// 自有的代码与常量池，执行只读代码时为空
+		std::vector<char> OwnedBytes;
+		std::vector<std::string> OwnedStrings;
+
+	public:
+		/// <summary>
+		/// 正在执行的代码与常量池，指向自有的副本或外部的只读区域
+		/// </summary>
+		std::span<const char> Bytes;
+		std::span<const std::string> Strings;
+		/// <summary>
+		/// 代码是否只读(见只读代码的构造函数)
+		/// </summary>
+		const bool ReadOnly = false;
 		SimpStack Stack;
 		size_t PC = 0;
+		/// <summary>
+		/// 预解码得到的处理例程地址表(以 PC 为下标)，仅 Threaded 引擎使用
+		/// </summary>
+		std::vector<const void*> Handlers;
+
+	private:
+		/// <summary>
+		/// 操作码到处理例程的映射，改写指令时用于更新 Handlers
+		/// </summary>
+		const void* Labels[256]{};
+		/// <summary>
+		/// 每处指令的去优化次数，第一次去优化时才分配
+		/// </summary>
+		std::vector<unsigned char> Deopts;
+		ScriptContext* Ctx = nullptr;
+		// Literals 所属上下文的编号
+		size_t CtxId = 0;
+		/// <summary>
+		/// Strings 对应的驻留字符串，第一次使用时创建
+		/// </summary>
+		std::vector<Variant> Literals;
+		CacheStats Stats;
+		const Variant& Literal(ScriptContext& ctx, size_t i) {
+			auto& v = Literals[i];
+			if (v.Type == Variant::DataType::Null)
+				v = ctx.Intern(Strings[i]);
+			return v;
+		}
+#if NZ_JIT
+		std::unordered_map<size_t, JitEntry> JitFunctions;
+		/// <summary>
+		/// 以函数入口的 PC 为下标的已编译函数，本机代码调用脚本函数时查这张表(见 x64::Runtime::Functions)
+		/// </summary>
+		std::vector<JitFunction> JitTable;
+		std::vector<std::unique_ptr<x64::ExecutableMemory>> JitCode;
+		std::exception_ptr Pending;
+#endif
 	};
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
 class Lexer {
 public:
 	enum class TokenType {
@@ -16,6 +17,8 @@ public:
 	struct Token {
 		TokenType type;
 		std::string_view lexeme;
+		// 所在的行(从 1 开始)
+		unsigned int line = 0;
 
 		Token(TokenType tokenType, std::string_view tokenLexeme)
 			: type(tokenType), lexeme(tokenLexeme) {}
@@ -25,9 +28,14 @@ public:
 
 	std::vector<Token> tokenize(bool parseComment = false) {
 		std::vector<Token> tokens;
+		// 已经统计过换行的位置
+		size_t counted = 0;
+		unsigned int line = 1;
 
 		while (position_ < input_.length()) {
 			char currentChar = input_[position_];
+			auto start = position_;
+			auto count = tokens.size();
 
 			if (isIdentifierStart(currentChar)) {
 				tokens.push_back(readIdentifier());
@@ -86,6 +94,11 @@ public:
 				// std::cerr << "Unknown character: " << currentChar << std::endl;
 				position_++;
 			}
+			if (tokens.size() != count) {
+				line += (unsigned int)std::count(input_.begin() + counted, input_.begin() + start, '\n');
+				counted = start;
+				tokens.back().line = line;
+			}
 		}
 
 		return tokens;
@@ -135,6 +148,9 @@ private:
 		size_t start = position_;
 
 		while (position_ < input_.length() && (isDigit(input_[position_]) || input_[position_] == '.' || input_[position_] == 'e' || input_[position_] == 'E')) {
+			// 0..10 中的 .. 是区间运算符，不属于数字
+			if (input_[position_] == '.' && position_ + 1 < input_.length() && input_[position_ + 1] == '.')
+				break;
 			position_++;
 		}
 
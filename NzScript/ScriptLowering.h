@@ -0,0 +1,302 @@
+﻿#pragma once
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <climits>
+#include "ScriptIr.h"
+/*
+寄存器化：
+
+栈指令在做 a = b + c 这样的语句时需要 PushLocal b、PushLocal c、Add、StoreLocal a、Pop 五条指令，
+每条都要经过一次分派并读写一次计算堆栈。
+
+Emitter 已经为每个本地变量和参数分配了固定的栈帧槽位，把这些槽位直接当作寄存器，
+就可以把上述序列改写为一条 RAdd a, b, c。
+
+这里是一个在 Emitter 输出上进行的改写过程：解码所有指令，匹配常见的语句模式，
+重新编码并修正所有跳转偏移与函数地址。被任何跳转指向的指令不会被合并到前一条指令中。
+*/
+namespace ir {
+	class RegisterLowering {
+		struct Instr {
+			size_t PC;
+			Opcode Op;
+			// 操作数的原始字节
+			std::vector<char> Operands;
+			// 分支指令的目标(原 PC)，非分支指令为 -1
+			size_t Target = (size_t)-1;
+			// 改写后的 PC
+			size_t NewPC = 0;
+		};
+		std::vector<Instr> Code;
+		std::unordered_set<size_t> Targets;
+
+		template <class T>
+		static T Operand(const Instr& ins) {
+			T v{};
+			memcpy(&v, ins.Operands.data(), sizeof(T));
+			return v;
+		}
+		template <class T>
+		static void Append(std::vector<char>& out, T v) {
+			out.insert(out.end(), (char*)&v, (char*)(&v + 1));
+		}
+		static bool IsBranch(Opcode op) {
+			return op == OP_Jmp || op == OP_Jz || op == OP_Jnz || op == OP_RCmpJnz || op == OP_RCmpIJnz || op == OP_MoveNext;
+		}
+		/// <summary>
+		/// 尝试把读取变量的指令转换为寄存器编号
+		/// </summary>
+		static bool AsRegister(const Instr& ins, Opcode push, Imm1& reg) {
+			auto local = push == OP_PushArg ? OP_PushLocalI1 : OP_StoreLocalI1;
+			auto arg = push == OP_PushArg ? OP_PushArg : OP_StoreArg;
+			if (ins.Op != local && ins.Op != arg)
+				return false;
+			auto i = Operand<Imm1>(ins);
+			if (i >= 0x80)
+				return false;
+			reg = ins.Op == arg ? (Imm1)(i | 0x80) : i;
+			return true;
+		}
+		static bool IsLoad(const Instr& ins, Imm1& reg) {
+			return AsRegister(ins, OP_PushArg, reg);
+		}
+		static bool IsStore(const Instr& ins, Imm1& reg) {
+			return AsRegister(ins, OP_StoreArg, reg);
+		}
+		static bool IsConst(const Instr& ins, Imm4& imm) {
+			switch (ins.Op) {
+			case OP_PushI4_0:
+				imm = 0;
+				return true;
+			case OP_PushI4_1:
+				imm = 1;
+				return true;
+			case OP_PushI4:
+				imm = Operand<Imm4>(ins);
+				return true;
+			default:
+				return false;
+			}
+		}
+		static bool IsPop(const Instr& ins) {
+			return ins.Op == OP_Pop || (ins.Op == OP_Popn && Operand<Imm1>(ins) == 1);
+		}
+		static bool IsCompare(Opcode op) {
+			switch (op) {
+			case OP_Equ:
+			case OP_Neq:
+			case OP_Gt:
+			case OP_Ge:
+			case OP_Lt:
+			case OP_Le:
+				return true;
+			default:
+				return false;
+			}
+		}
+		static Opcode RegisterForm(Opcode op) {
+			switch (op) {
+			case OP_Add:
+				return OP_RAdd;
+			case OP_Sub:
+				return OP_RSub;
+			case OP_Mul:
+				return OP_RMul;
+			case OP_Div:
+				return OP_RDiv;
+			default:
+				return OP_Nop;
+			}
+		}
+		/// <summary>
+		/// 窗口 [i, i + n) 内除第一条以外的指令都不能是跳转目标
+		/// </summary>
+		bool CanFuse(size_t i, size_t n) {
+			if (i + n > Code.size())
+				return false;
+			for (size_t j = i + 1; j < i + n; j++) {
+				if (Targets.contains(Code[j].PC))
+					return false;
+			}
+			return true;
+		}
+		Instr Make(const Instr& first, Opcode op) {
+			Instr ins{};
+			ins.PC = first.PC;
+			ins.Op = op;
+			return ins;
+		}
+		/// <summary>
+		/// 匹配位置 i 处的语句模式，成功时返回消耗的指令数
+		/// </summary>
+		size_t Match(size_t i, Instr& out) {
+			Imm1 a, b, d;
+			Imm4 k;
+			auto at = [&](size_t j) -> const Instr& { return Code[i + j]; };
+			// R a, R b, op, S d, Pop -> Rop d, a, b
+			if (CanFuse(i, 5) && IsLoad(at(0), a) && IsLoad(at(1), b) && RegisterForm(at(2).Op) != OP_Nop && IsStore(at(3), d) && IsPop(at(4))) {
+				out = Make(at(0), RegisterForm(at(2).Op));
+				Append(out.Operands, d);
+				Append(out.Operands, a);
+				Append(out.Operands, b);
+				return 5;
+			}
+			// R a, K k, Add/Sub, S d, Pop -> RAddI d, a, +-k
+			if (CanFuse(i, 5) && IsLoad(at(0), a) && IsConst(at(1), k) && (at(2).Op == OP_Add || (at(2).Op == OP_Sub && k != INT_MIN)) && IsStore(at(3), d) && IsPop(at(4))) {
+				out = Make(at(0), OP_RAddI);
+				Append(out.Operands, d);
+				Append(out.Operands, a);
+				Append(out.Operands, at(2).Op == OP_Add ? k : -k);
+				return 5;
+			}
+			// R a, Inc/Dec, S d, Pop -> RAddI d, a, +-1
+			if (CanFuse(i, 4) && IsLoad(at(0), a) && (at(1).Op == OP_Inc || at(1).Op == OP_Dec) && IsStore(at(2), d) && IsPop(at(3))) {
+				out = Make(at(0), OP_RAddI);
+				Append(out.Operands, d);
+				Append(out.Operands, a);
+				Append(out.Operands, (Imm4)(at(1).Op == OP_Inc ? 1 : -1));
+				return 4;
+			}
+			// 作为语句的后缀自增: R a, Dup, Inc/Dec, S d, Pop, Pop -> RAddI d, a, +-1
+			if (CanFuse(i, 6) && IsLoad(at(0), a) && at(1).Op == OP_Dup && (at(2).Op == OP_Inc || at(2).Op == OP_Dec) && IsStore(at(3), d) && IsPop(at(4)) && IsPop(at(5))) {
+				out = Make(at(0), OP_RAddI);
+				Append(out.Operands, d);
+				Append(out.Operands, a);
+				Append(out.Operands, (Imm4)(at(2).Op == OP_Inc ? 1 : -1));
+				return 6;
+			}
+			// R a, S d, Pop -> RMov d, a
+			if (CanFuse(i, 3) && IsLoad(at(0), a) && IsStore(at(1), d) && IsPop(at(2))) {
+				out = Make(at(0), OP_RMov);
+				Append(out.Operands, d);
+				Append(out.Operands, a);
+				return 3;
+			}
+			// K k, S d, Pop -> RLoadI d, k
+			if (CanFuse(i, 3) && IsConst(at(0), k) && IsStore(at(1), d) && IsPop(at(2))) {
+				out = Make(at(0), OP_RLoadI);
+				Append(out.Operands, d);
+				Append(out.Operands, k);
+				return 3;
+			}
+			// R a, R b, cmp, Jnz -> RCmpJnz cmp, a, b
+			if (CanFuse(i, 4) && IsLoad(at(0), a) && IsLoad(at(1), b) && IsCompare(at(2).Op) && at(3).Op == OP_Jnz) {
+				out = Make(at(0), OP_RCmpJnz);
+				Append(out.Operands, (Imm1)at(2).Op);
+				Append(out.Operands, a);
+				Append(out.Operands, b);
+				Append(out.Operands, (Imm4)0);
+				out.Target = at(3).Target;
+				return 4;
+			}
+			// R a, K k, cmp, Jnz -> RCmpIJnz cmp, a, k
+			if (CanFuse(i, 4) && IsLoad(at(0), a) && IsConst(at(1), k) && IsCompare(at(2).Op) && at(3).Op == OP_Jnz) {
+				out = Make(at(0), OP_RCmpIJnz);
+				Append(out.Operands, (Imm1)at(2).Op);
+				Append(out.Operands, a);
+				Append(out.Operands, k);
+				Append(out.Operands, (Imm4)0);
+				out.Target = at(3).Target;
+				return 4;
+			}
+			return 0;
+		}
+
+	public:
+		/// <summary>
+		/// 改写字节码，返回被合并掉的指令数
+		/// </summary>
+		size_t Run(std::vector<char>& bytes, std::vector<LineEntry>* lines = nullptr) {
+			Code.clear();
+			Targets.clear();
+			// 解码
+			size_t pc = 0;
+			while (pc < bytes.size()) {
+				Instr ins{};
+				ins.PC = pc;
+				ins.Op = static_cast<Opcode>(bytes[pc]);
+				auto sz = GetOperandSize(ins.Op);
+				ins.Operands.assign(bytes.begin() + pc + 1, bytes.begin() + pc + 1 + sz);
+				pc += 1 + sz;
+				if (IsBranch(ins.Op)) {
+					// 分支指令的偏移总是最后一个操作数
+					Imm4 off;
+					memcpy(&off, ins.Operands.data() + ins.Operands.size() - sizeof(Imm4), sizeof(off));
+					ins.Target = pc + off;
+					Targets.insert(ins.Target);
+				}
+				else if (ins.Op == OP_PushFuncPtr) {
+					Targets.insert(Operand<UImm4>(ins));
+				}
+				Code.push_back(std::move(ins));
+			}
+			// 匹配
+			std::vector<Instr> lowered;
+			size_t fused = 0;
+			for (size_t i = 0; i < Code.size();) {
+				Instr out{};
+				auto n = Match(i, out);
+				if (n == 0) {
+					lowered.push_back(Code[i]);
+					i++;
+					continue;
+				}
+				lowered.push_back(std::move(out));
+				fused += n - 1;
+				i += n;
+			}
+			// 布局，并建立新旧 PC 的映射
+			std::unordered_map<size_t, size_t> remap;
+			pc = 0;
+			for (auto& ins : lowered) {
+				ins.NewPC = pc;
+				remap[ins.PC] = pc;
+				pc += 1 + ins.Operands.size();
+			}
+			remap[bytes.size()] = pc;
+			// 行号表中的指令可能被合并，映射到包含它的那条指令
+			if (lines != nullptr) {
+				std::vector<LineEntry> relocated;
+				for (auto& e : *lines) {
+					auto it = std::upper_bound(lowered.begin(), lowered.end(), (size_t)e.PC, [](size_t pc, const Instr& ins) {
+						return pc < ins.PC;
+					});
+					auto newpc = it == lowered.begin() ? 0 : (unsigned int)std::prev(it)->NewPC;
+					if (e.PC >= bytes.size())
+						newpc = (unsigned int)pc;
+					// 合并后的指令属于它开始的那一行
+					if (relocated.empty() || relocated.back().PC != newpc)
+						relocated.push_back({ newpc, e.Line });
+				}
+				*lines = std::move(relocated);
+			}
+			// 重新编码，修正跳转偏移与函数地址
+			std::vector<char> out;
+			out.reserve(pc);
+			for (auto& ins : lowered) {
+				auto end = ins.NewPC + 1 + ins.Operands.size();
+				if (IsBranch(ins.Op)) {
+					auto off = (Imm4)((long long)remap.at(ins.Target) - (long long)end);
+					memcpy(ins.Operands.data() + ins.Operands.size() - sizeof(Imm4), &off, sizeof(off));
+				}
+				else if (ins.Op == OP_PushFuncPtr) {
+					auto target = (UImm4)remap.at(Operand<UImm4>(ins));
+					memcpy(ins.Operands.data(), &target, sizeof(target));
+				}
+				out.push_back(ins.Op);
+				out.insert(out.end(), ins.Operands.begin(), ins.Operands.end());
+			}
+			bytes = std::move(out);
+			return fused;
+		}
+	};
+	/// <summary>
+	/// 将 Emitter 的输出改写为寄存器形式的指令
+	/// </summary>
+	/// <returns>被合并掉的指令数</returns>
+	size_t LowerToRegisters(Emitter& em) {
+		RegisterLowering rl;
+		return rl.Run(em.Bytes, &em.Lines);
+	}
+}
@@ -1,5 +1,9 @@
 ﻿#pragma once
 #include "ScriptGC.h"
+#include <string>
+#include <memory>
+// 定义 NZ_NAN_BOXING 时，数组元素与对象字段以 8 字节的 NaN-boxing 形式保存(见 PackedVariant)；
+// PackedVariant 本身总是参与编译，未定义该宏时也能单独测试
 struct Variant {
 	using ScriptInternMethod = struct Variant (*)(class ScriptContext&, std::vector<struct Variant>&);
 	Variant() = default;
@@ -9,7 +13,7 @@ struct Variant {
 	Variant(float value) : Type(DataType::Float), Float(value) {}
 	Variant(double value) : Type(DataType::Double), Double(value) {}
 	Variant(GC& gc, const char* value) : Type(DataType::String) {
-		Object = new GCString(gc, value);
+		Object = new (gc) GCString(gc, value);
 	}
 	// Variant(Variant* value) : Type(DataType::VariantPtr), VariantPtr(value) {}
 	union {
@@ -19,6 +23,7 @@ struct Variant {
 		double Double;
 		GCObject* Object;
 		ScriptInternMethod InternMethod;
+		const struct NativeFunction* Native;
 		size_t Pointer;
 		// Variant* VariantPtr;
 	};
@@ -32,7 +37,8 @@ struct Variant {
 		IDisp_NotUsed,
 		Object,
 		Array_NotUsed,
-		Method_NotUsed,
+		// 零分配调用约定的原生函数(见 NativeFunction)
+		NativeMethod,
 		InternMethod,
 		String,
 		VariantPtr_NotUsed,
@@ -64,70 +70,428 @@ struct Variant {
 			throw std::exception("Left is not string.");
 		return ((GCString*)Object)->Pointer;
 	}
+	bool IsGCObject() const {
+		return Type == DataType::Object || Type == DataType::String;
+	}
+	void Trace(GC& gc) const {
+		if (IsGCObject())
+			gc.Visit(Object);
+	}
 };
 constexpr static Variant NullVariant = {};
+/// <summary>
+/// 以 NaN-boxing 编码的 8 字节值，用于数组元素与对象字段的存储
+/// 非 NaN 的 double 原样保存，所有 NaN 规范化为 QNaN；
+/// 其余类型放进 quiet NaN 的空间：符号位与 48~50 位组成 4 位标记，低 48 位是负载；
+/// 放不进 48 位的值(如超出范围的 Long)装箱到堆上
+/// </summary>
+class PackedVariant {
+	static constexpr unsigned long long QNaN = 0x7FF8000000000000ull;
+	static constexpr unsigned long long PayloadMask = 0x0000FFFFFFFFFFFFull;
+	enum Tag : unsigned {
+		// 即 QNaN 本身
+		TagNaN,
+		TagNull,
+		TagInt,
+		TagLong,
+		TagFloat,
+		TagObject,
+		TagString,
+		TagInternMethod,
+		TagNativeMethod,
+		TagReturnPC,
+		TagFuncPC,
+		TagPtr,
+		// 负载是指向堆上 Variant 的指针
+		TagBoxed,
+	};
+	unsigned long long Bits;
+
+	static constexpr unsigned long long Make(unsigned tag, unsigned long long payload) {
+		return QNaN | ((unsigned long long)(tag & 8) << 60) | ((unsigned long long)(tag & 7) << 48) | payload;
+	}
+	static constexpr Tag PointerTag(Variant::DataType type) {
+		switch (type) {
+		case Variant::DataType::Object:
+			return TagObject;
+		case Variant::DataType::String:
+			return TagString;
+		case Variant::DataType::InternMethod:
+			return TagInternMethod;
+		case Variant::DataType::NativeMethod:
+			return TagNativeMethod;
+		case Variant::DataType::ReturnPC:
+			return TagReturnPC;
+		case Variant::DataType::FuncPC:
+			return TagFuncPC;
+		case Variant::DataType::Ptr:
+			return TagPtr;
+		default:
+			return TagBoxed;
+		}
+	}
+	static bool IsDouble(unsigned long long bits) {
+		return (bits & QNaN) != QNaN || bits == QNaN;
+	}
+	static unsigned GetTag(unsigned long long bits) {
+		return (unsigned)((bits >> 60) & 8) | (unsigned)((bits >> 48) & 7);
+	}
+	static bool IsBoxed(unsigned long long bits) {
+		return !IsDouble(bits) && GetTag(bits) == TagBoxed;
+	}
+	static Variant* Boxed(unsigned long long bits) {
+		return (Variant*)(bits & PayloadMask);
+	}
+	static unsigned long long Encode(const Variant& v) {
+		switch (v.Type) {
+		case Variant::DataType::Null:
+			return Make(TagNull, 0);
+		case Variant::DataType::Int:
+			return Make(TagInt, (unsigned int)v.Int);
+		case Variant::DataType::Float: {
+			unsigned int f;
+			memcpy(&f, &v.Float, sizeof(f));
+			return Make(TagFloat, f);
+		}
+		case Variant::DataType::Double: {
+			if (v.Double != v.Double)
+				return QNaN;
+			unsigned long long d;
+			memcpy(&d, &v.Double, sizeof(d));
+			return d;
+		}
+		case Variant::DataType::Long:
+			if (v.Long >= -(1ll << 47) && v.Long < (1ll << 47))
+				return Make(TagLong, (unsigned long long)v.Long & PayloadMask);
+			break;
+		default:
+			if (PointerTag(v.Type) != TagBoxed && (v.Pointer & ~PayloadMask) == 0)
+				return Make(PointerTag(v.Type), v.Pointer);
+			break;
+		}
+		// 用户态指针只有 48 位，装箱后的指针总能放进负载
+		return Make(TagBoxed, (unsigned long long)new Variant(v));
+	}
+	static void Release(unsigned long long bits) {
+		if (IsBoxed(bits))
+			delete Boxed(bits);
+	}
+	// 复制时装箱的值需要另外分配
+	static unsigned long long Copy(unsigned long long bits) {
+		return IsBoxed(bits) ? Encode(*Boxed(bits)) : bits;
+	}
+
+public:
+	PackedVariant() : Bits(Make(TagNull, 0)) {}
+	PackedVariant(const Variant& v) : Bits(Encode(v)) {}
+	PackedVariant(const PackedVariant& v) : Bits(Copy(v.Bits)) {}
+	PackedVariant(PackedVariant&& v) noexcept : Bits(v.Bits) {
+		v.Bits = Make(TagNull, 0);
+	}
+	~PackedVariant() {
+		Release(Bits);
+	}
+	PackedVariant& operator=(const Variant& v) {
+		auto old = Bits;
+		Bits = Encode(v);
+		Release(old);
+		return *this;
+	}
+	PackedVariant& operator=(const PackedVariant& v) {
+		if (this != &v) {
+			auto old = Bits;
+			Bits = Copy(v.Bits);
+			Release(old);
+		}
+		return *this;
+	}
+	PackedVariant& operator=(PackedVariant&& v) noexcept {
+		if (this != &v) {
+			Release(Bits);
+			Bits = v.Bits;
+			v.Bits = Make(TagNull, 0);
+		}
+		return *this;
+	}
+	operator Variant() const {
+		Variant v{};
+		if (IsDouble(Bits)) {
+			v.Type = Variant::DataType::Double;
+			memcpy(&v.Double, &Bits, sizeof(Bits));
+			return v;
+		}
+		auto payload = Bits & PayloadMask;
+		switch (GetTag(Bits)) {
+		case TagNull:
+			return v;
+		case TagInt:
+			v.Type = Variant::DataType::Int;
+			v.Int = (int)(unsigned int)payload;
+			return v;
+		case TagLong:
+			v.Type = Variant::DataType::Long;
+			// 符号扩展 48 位负载
+			v.Long = (long long)(payload << 16) >> 16;
+			return v;
+		case TagFloat: {
+			v.Type = Variant::DataType::Float;
+			auto f = (unsigned int)payload;
+			memcpy(&v.Float, &f, sizeof(f));
+			return v;
+		}
+		case TagObject:
+			v.Type = Variant::DataType::Object;
+			break;
+		case TagString:
+			v.Type = Variant::DataType::String;
+			break;
+		case TagInternMethod:
+			v.Type = Variant::DataType::InternMethod;
+			break;
+		case TagNativeMethod:
+			v.Type = Variant::DataType::NativeMethod;
+			break;
+		case TagReturnPC:
+			v.Type = Variant::DataType::ReturnPC;
+			break;
+		case TagFuncPC:
+			v.Type = Variant::DataType::FuncPC;
+			break;
+		case TagPtr:
+			v.Type = Variant::DataType::Ptr;
+			break;
+		default:
+			return *Boxed(Bits);
+		}
+		v.Pointer = payload;
+		return v;
+	}
+};
+static_assert(sizeof(PackedVariant) == 8, "PackedVariant must be 8 bytes");
+#ifdef NZ_NAN_BOXING
+/// <summary>
+/// 数组与对象中保存值的类型
+/// </summary>
+using VariantSlot = PackedVariant;
+#else
+using VariantSlot = Variant;
+#endif
+/// <summary>
+/// 隐藏类(形状)：属性名到槽位的映射
+///
+/// 以相同顺序添加相同属性的对象共享同一个形状，添加属性时沿转移树找到(或创建)下一个形状；
+/// 共享的形状创建后不再改变。属性数超过 MaxSharedSlots 的对象转为字典模式，持有一个独占的形状并直接修改它，
+/// 避免把转移树撑大。形状不会被释放。
+/// </summary>
+class Shape {
+	struct NameHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view s) const {
+			return std::hash<std::string_view>{}(s);
+		}
+	};
+	std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> Table;
+	std::unordered_map<std::string, std::unique_ptr<Shape>, NameHash, std::equal_to<>> Transitions;
+	static std::mutex& TransitionLock() {
+		static std::mutex lock;
+		return lock;
+	}
+
+public:
+	static constexpr size_t MaxSharedSlots = 64;
+	static constexpr size_t NotFound = (size_t)-1;
+	/// <summary>
+	/// 槽位对应的属性名，按添加顺序排列
+	/// </summary>
+	std::vector<std::string> Names;
+	bool Dictionary = false;
+
+	/// <summary>
+	/// 没有属性的根形状
+	/// </summary>
+	static Shape* Empty() {
+		static Shape root;
+		return &root;
+	}
+	size_t Count() const {
+		return Names.size();
+	}
+	size_t Find(std::string_view name) const {
+		auto it = Table.find(name);
+		return it == Table.end() ? NotFound : it->second;
+	}
+	/// <summary>
+	/// 添加属性 name 后的形状(新属性的槽位是 Count())
+	/// </summary>
+	Shape* Transition(std::string_view name) {
+		std::lock_guard<std::mutex> lock(TransitionLock());
+		auto it = Transitions.find(name);
+		if (it != Transitions.end())
+			return it->second.get();
+		auto next = std::make_unique<Shape>(*this);
+		next->Add(name);
+		auto p = next.get();
+		Transitions.emplace(std::string(name), std::move(next));
+		return p;
+	}
+	/// <summary>
+	/// 复制为字典模式的独占形状
+	/// </summary>
+	std::unique_ptr<Shape> ToDictionary() const {
+		auto dict = std::make_unique<Shape>(*this);
+		dict->Dictionary = true;
+		return dict;
+	}
+	/// <summary>
+	/// 直接添加属性，只用于字典模式
+	/// </summary>
+	void Add(std::string_view name) {
+		Table.emplace(std::string(name), Names.size());
+		Names.emplace_back(name);
+	}
+
+	Shape() = default;
+	// 只复制属性表，不复制转移
+	Shape(const Shape& other) : Table(other.Table), Names(other.Names) {
+	}
+};
+/// <summary>
+/// 对象的类型标记(GCObject::GetKind)
+/// </summary>
+enum class ObjectKind : unsigned char {
+	Unknown,
+	Object,
+	Array,
+	Int32Array,
+	Int64Array,
+	Float64Array,
+	Range,
+};
 class ScriptObject : public GCObject {
+	// 字典模式下由对象独占的形状
+	std::unique_ptr<Shape> OwnShape;
+
 public:
-	ScriptObject(GC& gc) : GCObject(gc) {
+	ScriptObject(GC& gc, size_t size = sizeof(ScriptObject)) : GCObject(gc, size) {
+		Kind = (unsigned char)ObjectKind::Object;
 	}
 
 public:
-	std::unordered_map<std::string, Variant> Fields;
+	/// <summary>
+	/// 对象的形状，属性 name 的值保存在 Slots[Layout->Find(name)]
+	/// </summary>
+	Shape* Layout = Shape::Empty();
+	std::vector<VariantSlot> Slots;
 	const std::type_info& GetType() const noexcept override {
 		return typeid(ScriptObject);
 	}
-	void Set(std::string s, Variant v) {
-		auto& v2 = Fields[s];
-		if (v2.Type == Variant::DataType::Object || v.Type == Variant::DataType::String) {
-			RemoveRef(v2.Object);
-		}
-		if (v.Type == Variant::DataType::Object || v.Type == Variant::DataType::String) {
-			AddRef(v.Object);
+
+private:
+	// 追加一个空槽位，容量的变化计入堆预算
+	void AddSlot() {
+		auto before = Slots.capacity();
+		Slots.emplace_back();
+		Account(before * sizeof(VariantSlot), Slots.capacity() * sizeof(VariantSlot));
+	}
+
+public:
+	/// <summary>
+	/// 添加属性，返回它的槽位
+	/// </summary>
+	size_t AddProperty(std::string_view s) {
+		if (Layout->Dictionary)
+			Layout->Add(s);
+		else if (Layout->Count() >= Shape::MaxSharedSlots) {
+			OwnShape = Layout->ToDictionary();
+			Layout = OwnShape.get();
+			Layout->Add(s);
 		}
-		Fields[s] = v;
-		return;
+		else
+			Layout = Layout->Transition(s);
+		AddSlot();
+		return Slots.size() - 1;
 	}
-	Variant Get(std::string s) {
-		return Fields[s];
+	/// <summary>
+	/// 沿已知的转移添加属性(供内联缓存使用)，next 必须是 Layout 添加一个属性后的共享形状
+	/// </summary>
+	void ApplyTransition(Shape* next) {
+		Layout = next;
+		AddSlot();
+	}
+	void SetSlot(size_t slot, const Variant& v) {
+		Slots[slot] = v;
+		if (v.IsGCObject())
+			WriteBarrier(v.Object);
+	}
+	void Set(std::string_view s, Variant v) {
+		auto slot = Layout->Find(s);
+		if (slot == Shape::NotFound)
+			slot = AddProperty(s);
+		SetSlot(slot, v);
+	}
+	/// <summary>
+	/// 读取属性，不存在时返回 null
+	/// </summary>
+	Variant Get(std::string_view s) {
+		auto slot = Layout->Find(s);
+		if (slot == Shape::NotFound)
+			return {};
+		return Slots[slot];
+	}
+	void Trace(GC& gc) override {
+		for (auto& v : Slots)
+			Variant(v).Trace(gc);
 	}
 };
 class ScriptArray : public ScriptObject {
 public:
-	std::vector<Variant> Variants;
-	ScriptArray(GC& gc) : ScriptObject(gc) {
+	std::vector<VariantSlot> Variants;
+	ScriptArray(GC& gc) : ScriptObject(gc, sizeof(ScriptArray)) {
+		Kind = (unsigned char)ObjectKind::Array;
 	}
 	const std::type_info& GetType() const noexcept override {
 		return typeid(ScriptArray);
 	}
 	void Set(size_t index, Variant v) {
 		if (index >= Variants.size()) {
+			// 按倍数扩容，逐个追加元素时均摊为常数时间
+			if (index >= Variants.capacity())
+				Reserve(std::max(index + 1, Variants.capacity() * 2));
 			Variants.resize(index + 1);
 		}
-		auto& v2 = Variants[index];
-		if (v2.Type == Variant::DataType::Object || v.Type == Variant::DataType::String) {
-			RemoveRef(v2.Object);
-		}
-		if (v.Type == Variant::DataType::Object || v.Type == Variant::DataType::String) {
-			AddRef(v.Object);
-		}
 		Variants[index] = v;
-		return;
+		if (v.IsGCObject())
+			WriteBarrier(v.Object);
 	}
 	void Add(Variant v) {
-		if (v.Type == Variant::DataType::Object || v.Type == Variant::DataType::String) {
-			AddRef(v.Object);
-		}
+		auto before = Variants.capacity();
 		Variants.push_back(v);
-		return;
+		Account(before * sizeof(VariantSlot), Variants.capacity() * sizeof(VariantSlot));
+		if (v.IsGCObject())
+			WriteBarrier(v.Object);
+	}
+	/// <summary>
+	/// 预留元素空间，容量的变化计入堆预算
+	/// </summary>
+	void Reserve(size_t n) {
+		auto before = Variants.capacity();
+		Variants.reserve(n);
+		Account(before * sizeof(VariantSlot), Variants.capacity() * sizeof(VariantSlot));
 	}
 	size_t Size() {
 		return Variants.size();
 	}
+	void Trace(GC& gc) override {
+		ScriptObject::Trace(gc);
+		for (auto& v : Variants)
+			Variant(v).Trace(gc);
+	}
+	/// <summary>
+	/// 读取元素，越界时返回 null(不改变数组)
+	/// </summary>
 	Variant Get(size_t index) {
-		if (index >= Variants.size()) {
-			Variants.resize(index + 1);
+		if (index >= Variants.size())
 			return {};
-		}
 		return Variants[index];
 	}
 };
@@ -217,6 +581,102 @@ template <>
 std::string script_cast(Variant v) {
 	return v.ToString();
 }
+/// <summary>
+/// 紧凑的数值数组：元素以 T 直接保存，不带类型标记，也不含对象引用
+/// 长度在创建时确定，写入时把值转换为 T，越界访问抛出异常
+/// </summary>
+template <class T, ObjectKind K>
+class ScriptTypedArray : public GCObject {
+public:
+	std::vector<T> Data;
+	ScriptTypedArray(GC& gc, size_t size) : GCObject(gc, sizeof(ScriptTypedArray) + size * sizeof(T)), Data(size) {
+		Kind = (unsigned char)K;
+	}
+	const std::type_info& GetType() const noexcept override {
+		return typeid(ScriptTypedArray);
+	}
+	size_t Size() {
+		return Data.size();
+	}
+	Variant Get(size_t index) {
+		if (index >= Data.size())
+			throw std::runtime_error("Index out of range.");
+		return Variant{ Data[index] };
+	}
+	void Set(size_t index, const Variant& v) {
+		if (index >= Data.size())
+			throw std::runtime_error("Index out of range.");
+		Data[index] = script_cast<T>(v);
+	}
+};
+/// <summary>
+/// 整数区间 [Start, End)，由 a..b 创建
+/// 只保存两端，元素按需计算，不论区间多大都只占一个对象
+/// </summary>
+class ScriptRange : public GCObject {
+public:
+	long long Start;
+	long long End;
+	// 任一端为 Long 时元素也是 Long，否则是 Int
+	bool Wide;
+	ScriptRange(GC& gc, long long start, long long end, bool wide)
+		: GCObject(gc, sizeof(ScriptRange)), Start(std::min(start, end)), End(std::max(start, end)), Wide(wide) {
+		Kind = (unsigned char)ObjectKind::Range;
+	}
+	/// <summary>
+	/// 按 a..b 的规则创建区间：两端必须是整数，b 小于 a 时交换两端
+	/// </summary>
+	static Variant Create(GC& gc, const Variant& lft, const Variant& rht) {
+		auto isInt = [](const Variant& v) { return v.Type == Variant::DataType::Int || v.Type == Variant::DataType::Long; };
+		if (!isInt(lft) || !isInt(rht))
+			throw std::exception("Range bounds must be integers.");
+		auto wide = lft.Type == Variant::DataType::Long || rht.Type == Variant::DataType::Long;
+		auto lo = lft.Type == Variant::DataType::Long ? lft.Long : lft.Int;
+		auto hi = rht.Type == Variant::DataType::Long ? rht.Long : rht.Int;
+		Variant v{};
+		v.Type = Variant::DataType::Object;
+		v.Object = new (gc) ScriptRange(gc, lo, hi, wide);
+		return v;
+	}
+	const std::type_info& GetType() const noexcept override {
+		return typeid(ScriptRange);
+	}
+	size_t Size() {
+		return (size_t)(End - Start);
+	}
+	/// <summary>
+	/// 第 index 个元素，越界时返回 null
+	/// </summary>
+	Variant Get(size_t index) {
+		if (index >= Size())
+			return {};
+		if (Wide)
+			return Variant{ Start + (long long)index };
+		return Variant{ (int)(Start + (long long)index) };
+	}
+};
+using Int32Array = ScriptTypedArray<int, ObjectKind::Int32Array>;
+using Int64Array = ScriptTypedArray<long long, ObjectKind::Int64Array>;
+using Float64Array = ScriptTypedArray<double, ObjectKind::Float64Array>;
+/// <summary>
+/// 按类型标记对任意数值数组调用 fn(typedArray)，不是数值数组时返回 false
+/// </summary>
+template <class F>
+bool VisitTypedArray(GCObject* obj, F&& fn) {
+	switch ((ObjectKind)obj->GetKind()) {
+	case ObjectKind::Int32Array:
+		fn((Int32Array*)obj);
+		return true;
+	case ObjectKind::Int64Array:
+		fn((Int64Array*)obj);
+		return true;
+	case ObjectKind::Float64Array:
+		fn((Float64Array*)obj);
+		return true;
+	default:
+		return false;
+	}
+}
 std::string Variant::ToString() const {
 	switch (Type) {
 	case DataType::Null:
@@ -233,10 +693,11 @@ std::string Variant::ToString() const {
 		const auto& typ = Object->GetType();
 		if (typ == typeid(ScriptObject)) {
 			std::string s = "{";
-			for (auto p : ((ScriptObject*)Object)->Fields) {
-				s += p.first;
+			auto obj = (ScriptObject*)Object;
+			for (size_t i = 0; i < obj->Slots.size(); i++) {
+				s += obj->Layout->Names[i];
 				s += "=";
-				s += p.second.ToString();
+				s += Variant(obj->Slots[i]).ToString();
 				s += ",";
 			}
 			if (s.size() != 1)
@@ -246,7 +707,7 @@ std::string Variant::ToString() const {
 		}
 		if (typ == typeid(ScriptArray)) {
 			std::string s = "[";
-			for (auto p : ((ScriptArray*)Object)->Variants) {
+			for (Variant p : ((ScriptArray*)Object)->Variants) {
 				s += p.ToString();
 				s += ",";
 			}
@@ -255,12 +716,29 @@ std::string Variant::ToString() const {
 			s += "]";
 			return s;
 		}
+		if (Object->GetKind() == (unsigned char)ObjectKind::Range) {
+			auto r = (ScriptRange*)Object;
+			return std::to_string(r->Start) + ".." + std::to_string(r->End);
+		}
+		std::string s = "[";
+		if (VisitTypedArray(Object, [&](auto arr) {
+				for (auto x : arr->Data) {
+					s += Variant{ x }.ToString();
+					s += ",";
+				}
+			})) {
+			if (s.size() != 1)
+				s.erase(s.end() - 1);
+			s += "]";
+			return s;
+		}
 		return "Unknown";
 	}
 	case DataType::InternMethod:
+	case DataType::NativeMethod:
 		return "{Internal Method}";
 	case DataType::String:
-		return ((GCString*)Object)->Pointer;
+		return std::string(((GCString*)Object)->View());
 	default:
 		return "Unknown";
 	}
@@ -393,7 +871,7 @@ Variant operator==(const Variant& lft, const Variant& rht) {
 		}
 	}
 	if (lft.Type == Variant::DataType::String && rht.Type == Variant::DataType::String) {
-		return Variant{ strcmp(lft.GetString(), rht.GetString()) == 0 };
+		return Variant{ GCString::Equals((GCString*)lft.Object, (GCString*)rht.Object) };
 	}
 	if (lft.Type != rht.Type) {
 		return Variant{ 0 };
@@ -416,7 +894,7 @@ Variant operator!=(const Variant& lft, const Variant& rht) {
 		}
 	}
 	if (lft.Type == Variant::DataType::String && rht.Type == Variant::DataType::String) {
-		return Variant{ strcmp(lft.GetString(), rht.GetString()) != 0 };
+		return Variant{ !GCString::Equals((GCString*)lft.Object, (GCString*)rht.Object) };
 	}
 	if (lft.Type != rht.Type) {
 		return Variant{ 1 };
@@ -0,0 +1,321 @@
+﻿#pragma once
+#include "ScriptContext.h"
+#include <cmath>
+#include <vector>
+// x86 上使用 SSE2 指令处理连续的 double，其余平台退回到普通循环
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NZ_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define NZ_SIMD_SSE2 0
+#endif
+namespace simd {
+	/// <summary>
+	/// 数组元素展开后的类型
+	/// </summary>
+	enum class ElementKind {
+		// 全部是 Int 或 Long，展开到 Ints
+		Integer,
+		// 含有浮点数，展开到 Doubles
+		Real,
+	};
+	/// <summary>
+	/// 把数组(或数值数组)展开为连续的 long long 或 double，供下面的向量化核心使用
+	/// 缓冲区是线程局部的，反复调用时不会重新分配；只填充元素类型需要的那一个
+	/// </summary>
+	struct Unpacked {
+		ElementKind Kind = ElementKind::Integer;
+		// Integer 时元素是否全部是 Int(而不是 Long)
+		bool Narrow = true;
+		std::vector<long long> Ints;
+		std::vector<double> Doubles;
+		/// <summary>
+		/// 调用结束后保留的最大元素数，一次大调用之后释放缓冲区，不长期占用内存
+		/// </summary>
+		static constexpr size_t MaxRetained = 64 << 10;
+		size_t Size() const {
+			return Kind == ElementKind::Integer ? Ints.size() : Doubles.size();
+		}
+		void Trim() {
+			if (Ints.capacity() > MaxRetained)
+				std::vector<long long>().swap(Ints);
+			if (Doubles.capacity() > MaxRetained)
+				std::vector<double>().swap(Doubles);
+		}
+	};
+	/// <summary>
+	/// 线程局部缓冲区的使用范围，离开时调用 Trim
+	/// </summary>
+	struct Scratch {
+		Unpacked& Buf;
+		~Scratch() {
+			Buf.Trim();
+		}
+	};
+	/// <summary>
+	/// 只读的连续元素：Int64Array 与 Float64Array 直接指向元素，其余指向 Unpacked 的缓冲区
+	/// </summary>
+	struct View {
+		ElementKind Kind = ElementKind::Integer;
+		const long long* Ints = nullptr;
+		const double* Doubles = nullptr;
+		size_t Size = 0;
+	};
+	inline ScriptArray* ArrayArg(const Variant& v) {
+		if (v.Type != Variant::DataType::Object || v.Object->GetKind() != (unsigned char)ObjectKind::Array)
+			throw std::exception("Argument must be an array.");
+		return (ScriptArray*)v.Object;
+	}
+	/// <summary>
+	/// 展开数组。real 为 true 时整数也转换为 double(供浮点运算使用)，此时 Kind 总是 Real
+	/// </summary>
+	inline void Unpack(const Variant& src, Unpacked& out, bool real = false) {
+		out.Ints.clear();
+		out.Doubles.clear();
+		// 数值数组已经是连续的，整块转换即可
+		if (src.Type == Variant::DataType::Object && VisitTypedArray(src.Object, [&](auto arr) {
+				using T = std::remove_cvref_t<decltype(arr->Data[0])>;
+				if (std::is_floating_point_v<T> || real) {
+					out.Kind = ElementKind::Real;
+					out.Doubles.assign(arr->Data.begin(), arr->Data.end());
+				}
+				else {
+					out.Kind = ElementKind::Integer;
+					out.Narrow = std::is_same_v<T, int>;
+					out.Ints.assign(arr->Data.begin(), arr->Data.end());
+				}
+			}))
+			return;
+		auto arr = ArrayArg(src);
+		auto n = arr->Variants.size();
+		// 先确定元素类型，只填充需要的缓冲区
+		out.Kind = real ? ElementKind::Real : ElementKind::Integer;
+		out.Narrow = true;
+		for (size_t i = 0; i < n; i++) {
+			Variant v = arr->Variants[i];
+			switch (v.Type) {
+			case Variant::DataType::Int:
+				break;
+			case Variant::DataType::Long:
+				out.Narrow = false;
+				break;
+			case Variant::DataType::Float:
+			case Variant::DataType::Double:
+				out.Kind = ElementKind::Real;
+				break;
+			default:
+				throw std::exception("Array must contain numbers only.");
+			}
+		}
+		if (out.Kind == ElementKind::Integer) {
+			out.Ints.resize(n);
+			for (size_t i = 0; i < n; i++) {
+				Variant v = arr->Variants[i];
+				out.Ints[i] = v.Type == Variant::DataType::Int ? v.Int : v.Long;
+			}
+		}
+		else {
+			out.Doubles.resize(n);
+			for (size_t i = 0; i < n; i++)
+				out.Doubles[i] = script_cast<double>(Variant(arr->Variants[i]));
+		}
+	}
+	/// <summary>
+	/// 取得只读视图，Int64Array 与 Float64Array 不复制
+	/// </summary>
+	inline View Read(const Variant& src, Unpacked& buf) {
+		View view;
+		if (src.Type == Variant::DataType::Object) {
+			switch ((ObjectKind)src.Object->GetKind()) {
+			case ObjectKind::Int64Array: {
+				auto& data = ((Int64Array*)src.Object)->Data;
+				view.Kind = ElementKind::Integer;
+				view.Ints = data.data();
+				view.Size = data.size();
+				return view;
+			}
+			case ObjectKind::Float64Array: {
+				auto& data = ((Float64Array*)src.Object)->Data;
+				view.Kind = ElementKind::Real;
+				view.Doubles = data.data();
+				view.Size = data.size();
+				return view;
+			}
+			default:
+				break;
+			}
+		}
+		Unpack(src, buf);
+		view.Kind = buf.Kind;
+		view.Ints = buf.Ints.data();
+		view.Doubles = buf.Doubles.data();
+		view.Size = buf.Size();
+		return view;
+	}
+	/// <summary>
+	/// 取得 double 形式的只读视图，整数视图转换到 buf.Doubles
+	/// </summary>
+	inline const double* ReadReal(const View& view, std::vector<double>& buf) {
+		if (view.Kind == ElementKind::Real)
+			return view.Doubles;
+		buf.assign(view.Ints, view.Ints + view.Size);
+		return buf.data();
+	}
+	inline double SumF64(const double* p, size_t n) {
+		size_t i = 0;
+		double s = 0;
+#if NZ_SIMD_SSE2
+		// 两个累加器，隐藏加法的延迟
+		__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+		for (; i + 4 <= n; i += 4) {
+			a0 = _mm_add_pd(a0, _mm_loadu_pd(p + i));
+			a1 = _mm_add_pd(a1, _mm_loadu_pd(p + i + 2));
+		}
+		a0 = _mm_add_pd(a0, a1);
+		s = _mm_cvtsd_f64(_mm_add_sd(a0, _mm_unpackhi_pd(a0, a0)));
+#endif
+		for (; i < n; i++)
+			s += p[i];
+		return s;
+	}
+	inline double DotF64(const double* a, const double* b, size_t n) {
+		size_t i = 0;
+		double s = 0;
+#if NZ_SIMD_SSE2
+		__m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+		for (; i + 4 <= n; i += 4) {
+			a0 = _mm_add_pd(a0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+			a1 = _mm_add_pd(a1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+		}
+		a0 = _mm_add_pd(a0, a1);
+		s = _mm_cvtsd_f64(_mm_add_sd(a0, _mm_unpackhi_pd(a0, a0)));
+#endif
+		for (; i < n; i++)
+			s += a[i] * b[i];
+		return s;
+	}
+	inline void SqrtF64(double* p, size_t n) {
+		size_t i = 0;
+#if NZ_SIMD_SSE2
+		for (; i + 2 <= n; i += 2)
+			_mm_storeu_pd(p + i, _mm_sqrt_pd(_mm_loadu_pd(p + i)));
+#endif
+		for (; i < n; i++)
+			p[i] = std::sqrt(p[i]);
+	}
+	inline void AbsF64(double* p, size_t n) {
+		size_t i = 0;
+#if NZ_SIMD_SSE2
+		// 清除符号位
+		const __m128d sign = _mm_set1_pd(-0.0);
+		for (; i + 2 <= n; i += 2)
+			_mm_storeu_pd(p + i, _mm_andnot_pd(sign, _mm_loadu_pd(p + i)));
+#endif
+		for (; i < n; i++)
+			p[i] = std::fabs(p[i]);
+	}
+	// 整数核心写成简单的循环，由编译器自动向量化
+	inline long long SumI64(const long long* p, size_t n) {
+		long long s = 0;
+		for (size_t i = 0; i < n; i++)
+			s += p[i];
+		return s;
+	}
+	inline long long DotI64(const long long* a, const long long* b, size_t n) {
+		long long s = 0;
+		for (size_t i = 0; i < n; i++)
+			s += a[i] * b[i];
+		return s;
+	}
+	/// <summary>
+	/// 由展开的元素创建数组，元素以 E 类型保存
+	/// </summary>
+	template <class T, class E = T>
+	Variant MakeArray(ScriptContext& ctx, const std::vector<T>& src) {
+		auto arr = new (ctx.gc) ScriptArray(ctx.gc);
+		arr->Reserve(src.size());
+		// 数值不是 GC 对象，不需要写屏障
+		for (auto& x : src)
+			arr->Variants.push_back(Variant{ (E)x });
+		Variant v{};
+		v.Type = Variant::DataType::Object;
+		v.Object = arr;
+		return v;
+	}
+	/// <summary>
+	/// 对数组的每个元素应用 fn，结果为 double 数组
+	/// 超越函数没有可移植的 SIMD 实现，这里只保证循环连续、无分派，交给编译器向量化
+	/// </summary>
+	template <double (*Fn)(double)>
+	Variant MapF64(ScriptContext& ctx, NativeArgs vars) {
+		thread_local Unpacked buf;
+		Scratch scratch{ buf };
+		Unpack(vars[0], buf, true);
+		auto p = buf.Doubles.data();
+		for (size_t i = 0, n = buf.Doubles.size(); i < n; i++)
+			p[i] = Fn(p[i]);
+		return MakeArray(ctx, buf.Doubles);
+	}
+	inline double Sin(double x) {
+		return std::sin(x);
+	}
+	inline double Cos(double x) {
+		return std::cos(x);
+	}
+	inline double Exp(double x) {
+		return std::exp(x);
+	}
+	inline double Log(double x) {
+		return std::log(x);
+	}
+}
+void LoadVector(ScriptContext& ctx) {
+	ctx.NativeFunctions["array_sum"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		thread_local simd::Unpacked buf;
+		simd::Scratch scratch{ buf };
+		auto v = simd::Read(vars[0], buf);
+		if (v.Kind == simd::ElementKind::Integer)
+			return simd::SumI64(v.Ints, v.Size);
+		return simd::SumF64(v.Doubles, v.Size);
+	}, 1, 1, "Usage: array_sum(arr)." };
+	ctx.NativeFunctions["array_dot"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		thread_local simd::Unpacked a, b;
+		simd::Scratch sa{ a }, sb{ b };
+		auto va = simd::Read(vars[0], a);
+		auto vb = simd::Read(vars[1], b);
+		if (va.Size != vb.Size)
+			throw std::exception("Arrays must have the same length.");
+		if (va.Kind == simd::ElementKind::Integer && vb.Kind == simd::ElementKind::Integer)
+			return simd::DotI64(va.Ints, vb.Ints, va.Size);
+		// 一边是整数时转换到另一个缓冲区(整数视图不会用到 Doubles)
+		auto pa = simd::ReadReal(va, a.Doubles);
+		auto pb = simd::ReadReal(vb, b.Doubles);
+		return simd::DotF64(pa, pb, va.Size);
+	}, 2, 2, "Usage: array_dot(a,b)." };
+	ctx.NativeFunctions["map_sqrt"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		thread_local simd::Unpacked buf;
+		simd::Scratch scratch{ buf };
+		simd::Unpack(vars[0], buf, true);
+		simd::SqrtF64(buf.Doubles.data(), buf.Doubles.size());
+		return simd::MakeArray(ctx, buf.Doubles);
+	}, 1, 1, "Usage: map_sqrt(arr)." };
+	ctx.NativeFunctions["map_abs"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+		thread_local simd::Unpacked buf;
+		simd::Scratch scratch{ buf };
+		simd::Unpack(vars[0], buf);
+		// 与 abs 一致，整数数组的结果仍是整数，全部是 Int 时仍是 Int
+		if (buf.Kind == simd::ElementKind::Integer) {
+			for (auto& x : buf.Ints)
+				x = x < 0 ? -x : x;
+			if (buf.Narrow)
+				return simd::MakeArray<long long, int>(ctx, buf.Ints);
+			return simd::MakeArray(ctx, buf.Ints);
+		}
+		simd::AbsF64(buf.Doubles.data(), buf.Doubles.size());
+		return simd::MakeArray(ctx, buf.Doubles);
+	}, 1, 1, "Usage: map_abs(arr)." };
+	ctx.NativeFunctions["map_sin"] = { simd::MapF64<simd::Sin>, 1, 1, "Usage: map_sin(arr)." };
+	ctx.NativeFunctions["map_cos"] = { simd::MapF64<simd::Cos>, 1, 1, "Usage: map_cos(arr)." };
+	ctx.NativeFunctions["map_exp"] = { simd::MapF64<simd::Exp>, 1, 1, "Usage: map_exp(arr)." };
+	ctx.NativeFunctions["map_log"] = { simd::MapF64<simd::Log>, 1, 1, "Usage: map_log(arr)." };
+}
@@ -1,4 +1,4 @@
-#include "pch.h"
+﻿#include "pch.h"
 #include "CppUnitTest.h"
 
 #include "ScriptVariant.h"
@@ -9,7 +9,11 @@
 #include "ScriptOptimizer.h"
 #include "GameBuffer.h"
 #include "ScriptJit.h"
+#include "ScriptLowering.h"
+#include "ScriptBytecode.h"
 #include <random>
+#include <chrono>
+#include <limits>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -17,20 +21,41 @@ namespace NzTest
 {
 	TEST_CLASS(Scripting)
 	{
-		Variant RunScript(const std::string& content) {
+		// 默认生成 Program::Emit 的栈指令(嵌入者得到的就是它)，lower 为 true 时再改写为寄存器形式
+		ir::Emitter Compile(const std::string& content, bool lower = false) {
 			Lexer lex(content);
 			Parser p{ lex.tokenize() };
-			AST::Program* program = p.parse();
 			ir::Emitter em;
 			em.ctx = &ctx;
-			program->Emit(em);
+			p.parse()->Emit(em);
+			if (lower)
+				ir::LowerToRegisters(em);
+			return em;
+		}
+		Variant RunScript(const std::string& content, ir::Interpreter::Engine engine = ir::Interpreter::Engine::Switch, bool jit = false, bool lower = false) {
+			auto em = Compile(content, lower);
 			ir::Interpreter ir(em.Bytes, em.Strings);
+			ir.Mode = engine;
+			ir.JitEnabled = jit;
 			return ir.Run(ctx);
 		}
+		double BenchScript(const std::string& content, ir::Interpreter::Engine engine, Variant expected, bool jit = false) {
+			// 只计时 Run，词法、语法分析和代码生成不计入
+			auto em = Compile(content, true);
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			ir.Mode = engine;
+			ir.JitEnabled = jit;
+			auto begin = std::chrono::steady_clock::now();
+			auto result = ir.Run(ctx);
+			auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+			Assert::IsTrue(result == expected);
+			return elapsed;
+		}
 	public:
 		Scripting() {
 			LoadBasic(ctx);
 			LoadCMath(ctx);
+			LoadVector(ctx);
 		}
 		ScriptContext ctx;
 		std::random_device rd;
@@ -182,5 +207,870 @@ a.b.b.b.b.b = 114514;
 return a.b;
 )a") == Variant{ 114514 });
 		}
+		// 只记录耗时，不做断言：默认不运行，需要时在测试资源管理器中单独运行
+		BEGIN_TEST_METHOD_ATTRIBUTE(EngineBenchmark)
+			TEST_IGNORE()
+		END_TEST_METHOD_ATTRIBUTE()
+		TEST_METHOD(EngineBenchmark) {
+			const char* fib = R"a(
+var func_0 = function(n){
+	if(n<=2)
+		return 1;
+	else
+		return func_0(n-1) + func_0(n-2);
+};
+return func_0(27);
+)a";
+			const char* loop = R"a(
+a = 0;
+for(i = 0;i<60000;++i)
+	a = a + i;
+return a;
+)a";
+			for (auto engine : { ir::Interpreter::Engine::Switch, ir::Interpreter::Engine::Threaded }) {
+				auto name = engine == ir::Interpreter::Engine::Switch ? "Switch" : "Threaded";
+				auto t1 = BenchScript(fib, engine, Variant{ 196418 });
+				auto t2 = BenchScript(loop, engine, Variant{ 1799970000 });
+				Logger::WriteMessage(std::format("{}: fib(27) {:.2f}ms, loop {:.2f}ms\n", name, t1, t2).c_str());
+			}
+			auto t1 = BenchScript(fib, ir::Interpreter::Engine::Switch, Variant{ 196418 }, true);
+			auto t2 = BenchScript(loop, ir::Interpreter::Engine::Switch, Variant{ 1799970000 }, true);
+			Logger::WriteMessage(std::format("Jit: fib(27) {:.2f}ms, loop {:.2f}ms\n", t1, t2).c_str());
+		}
+		TEST_METHOD(JitScriptTest) {
+			// JIT 默认关闭，这里显式开启并与解释执行的结果对比
+			const char* scripts[] = {
+				R"a(
+var fib = function(n){
+	if(n<=2)
+		return 1;
+	return fib(n-1) + fib(n-2);
+};
+return fib(20);
+)a",
+				R"a(
+var mix = function(n){
+	let s = 0;
+	for(i = 0;i<n;i++) {
+		if(i * 2 < n)
+			s = s + i * 0.5;
+		else
+			s = s - i;
+	}
+	return s;
+};
+let t = 0;
+for(j = 0;j<30;j++)
+	t = t + mix(j);
+return t;
+)a",
+				R"a(
+var step = function(p, k){
+	p.x = p.x + k;
+	p.y = p.y * 2 - p.x;
+	return p.y;
+};
+let p = object();
+p.x = 1;
+p.y = 0.5;
+let t = 0;
+for(j = 0;j<30;j++)
+	t = t + step(p, j) / 1024;
+return t;
+)a",
+				// 已编译的函数之间直接调用并返回
+				R"a(
+var odd = 0;
+var even = function(n){
+	if(n == 0)
+		return 1;
+	return odd(n - 1);
+};
+odd = function(n){
+	if(n == 0)
+		return 0;
+	return even(n - 1);
+};
+let s = 0;
+for(j = 0;j<40;j++)
+	s = s + even(j) * j;
+return s;
+)a",
+			};
+			for (auto script : scripts) {
+				auto expected = RunScript(script);
+				auto em = Compile(script, true);
+				ir::Interpreter ir(em.Bytes, em.Strings);
+				ir.JitEnabled = true;
+				Assert::IsTrue(ir.Run(ctx) == expected);
+#if NZ_JIT
+				Assert::IsTrue(ir.GetJitCompiledCount() > 0);
+#endif
+			}
+		}
+		TEST_METHOD(RegisterLoweringTest) {
+			const char* script = R"a(
+let a = 0, b = 3, c = 0;
+for(i = 0;i<100;i++) {
+	a = a + i;
+	b = b * 2;
+	b = b - 5;
+	c = a;
+	c += 7;
+	if (i >= 50)
+		break;
+}
+var f = function(n, m){
+	n = n - m;
+	return n;
+};
+return a + b + c + f(10, 4);
+)a";
+			auto run = [&](bool lower) {
+				auto em = Compile(script);
+				auto size = em.Bytes.size();
+				if (lower)
+					Assert::IsTrue(ir::LowerToRegisters(em) > 0 && em.Bytes.size() < size);
+				ir::Interpreter ir(em.Bytes, em.Strings);
+				return ir.Run(ctx);
+			};
+			Assert::IsTrue(run(false) == run(true));
+		}
+		TEST_METHOD(JitTest) {
+			const char* script = R"a(
+var fib = function(n){
+	if(n<=2)
+		return 1;
+	else
+		return fib(n-1) + fib(n-2);
+};
+var sum = function(n, k){
+	let s = 0;
+	for(i = 0;i<n;i++) {
+		s = s + i * k;
+		s = s - 1;
+	}
+	return s;
+};
+var div = function(a, b){
+	let r = a / b;
+	if(r > 1.5)
+		return r;
+	return sqrt(r);
+};
+var fail = function(n){
+	if(n > 30)
+		throw n;
+	return n;
+};
+let total = 0;
+for(j = 0;j<40;j++) {
+	total = total + sum(j, 3) + fib(10);
+	total = total + fail(j);
+}
+return total + div(9, 2.0) + div(1, 4.0);
+)a";
+			auto run = [&](bool jit) {
+				auto em = Compile(script, true);
+				ir::Interpreter ir(em.Bytes, em.Strings);
+				ir.JitEnabled = jit;
+				ir.JitThreshold = 2;
+				try {
+					ir.Run(ctx);
+				}
+				catch (std::runtime_error&) {
+				}
+				if (jit)
+					Assert::IsTrue(ir.GetJitCompiledCount() > 0);
+				return ctx.LookupGlobal("total");
+			};
+			Assert::IsTrue(run(false) == run(true));
+		}
+		TEST_METHOD(QuickeningTest) {
+			const char* script = R"a(
+var add = function(a, b){
+	return a + b;
+};
+let s = 0;
+for(i = 0;i<20;i++)
+	s = add(s, i);
+let d = add(1.5, 2.25);
+let m = add(s, 0.5);
+for(i = 0;i<20;i++)
+	s = add(s, i);
+return s + d + m;
+)a";
+			for (auto engine : { ir::Interpreter::Engine::Switch, ir::Interpreter::Engine::Threaded }) {
+				for (bool jit : { false, true }) {
+					auto em = Compile(script, true);
+					ir::Interpreter ir(em.Bytes, em.Strings);
+					ir.Mode = engine;
+					ir.JitEnabled = jit;
+					Assert::IsTrue(ir.Run(ctx) == Variant{ 574.25 });
+				}
+			}
+		}
+		TEST_METHOD(GenerationalGCTest) {
+			GC gc;
+			auto old = new (gc) ScriptObject(gc);
+			gc.AddRoot(old);
+			for (int i = 0; i < GC::TenureAge; i++)
+				gc.Collect(false);
+			Assert::IsTrue(gc.OldCount() == 1 && gc.NurseryCount() == 0);
+			// 只被老年代对象引用的新生代对象要靠记忆集存活
+			Variant young{};
+			young.Type = Variant::DataType::Object;
+			young.Object = new (gc) ScriptObject(gc);
+			old->Set("young", young);
+			new (gc) ScriptObject(gc);
+			gc.Collect(false);
+			Assert::IsTrue(gc.Stats.LastFreed == 1 && gc.ObjectCount() == 2);
+			Assert::IsTrue(gc.Stats.MinorCollections == GC::TenureAge + 1 && gc.Stats.MajorCollections == 0);
+			gc.RemoveRoot(old);
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 0 && gc.Stats.MajorCollections == 1);
+		}
+		TEST_METHOD(TracedFieldsTest) {
+			GC gc;
+			auto obj = new (gc) ScriptObject(gc);
+			auto arr = new (gc) ScriptArray(gc);
+			gc.AddRoot(obj);
+			gc.AddRoot(arr);
+			Variant shared{};
+			shared.Type = Variant::DataType::Object;
+			shared.Object = new (gc) ScriptObject(gc);
+			// 覆盖其中一个字段后，另一个字段仍然持有引用
+			obj->Set("a", shared);
+			obj->Set("b", shared);
+			obj->Set("a", Variant{});
+			arr->Add(shared);
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 3);
+			obj->Set("b", Variant{});
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 3);
+			arr->Set(0, Variant{});
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 2);
+			gc.RemoveRoot(arr);
+			gc.RemoveRoot(obj);
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 0);
+		}
+		TEST_METHOD(InternedStringTest) {
+			// 字符串常量复用同一个驻留对象，循环中不再分配
+			Assert::IsTrue(RunScript(R"a(
+n = objcount();
+let hits = 0;
+for(i = 0;i<1000;i++) {
+	let e = "click";
+	if(e == "click")
+		hits++;
+}
+return hits == 1000 && objcount() - n < 4 && hex(255) == "ff" && hex(255) != "fe";
+)a") == Variant{ 1 });
+			auto a = ctx.Intern("event");
+			Assert::IsTrue(a.Object == ctx.Intern("event").Object);
+			Assert::IsTrue((a == Variant{ ctx.gc, "event" }) == Variant{ 1 });
+			ctx.gc.Collect(true);
+			Assert::IsTrue(ctx.Intern("event") == "event");
+		}
+		TEST_METHOD(LiteralCacheContextTest) {
+			auto em = Compile(R"a(return "event";)a");
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			// 在同一块内存上先后构造两个上下文，地址相同，缓存的驻留字符串不能沿用
+			alignas(ScriptContext) unsigned char storage[sizeof(ScriptContext)];
+			auto first = new (storage) ScriptContext();
+			auto id = first->Id;
+			Assert::IsTrue(ir.Run(*first) == "event");
+			first->~ScriptContext();
+			auto second = new (storage) ScriptContext();
+			Assert::IsTrue(second->Id != id);
+			auto v = ir.Run(*second);
+			Assert::IsTrue(v == "event");
+			Assert::IsTrue(v.Object == second->Intern("event").Object);
+			second->~ScriptContext();
+		}
+		TEST_METHOD(ShapeTest) {
+			auto make = [&](bool reversed) {
+				auto obj = new (ctx.gc) ScriptObject(ctx.gc);
+				obj->Set(reversed ? "y" : "x", 1);
+				obj->Set(reversed ? "x" : "y", 2);
+				return obj;
+			};
+			auto a = make(false), b = make(false), c = make(true);
+			// 以相同顺序添加属性的对象共享形状
+			Assert::IsTrue(a->Layout == b->Layout && a->Layout != c->Layout);
+			Assert::IsTrue(a->Get("y") == Variant{ 2 });
+			Assert::IsTrue(c->Get("y") == Variant{ 1 });
+			Assert::IsTrue(a->Get("z") == NullVariant);
+			a->Set("x", 3);
+			Assert::IsTrue(a->Layout == b->Layout);
+			Assert::IsTrue(a->Get("x") == Variant{ 3 });
+			Assert::IsTrue(b->Get("x") == Variant{ 1 });
+			// 属性过多时转为字典模式
+			for (int i = 0; i < 100; i++)
+				a->Set("p" + std::to_string(i), i);
+			Assert::IsTrue(a->Layout->Dictionary && a->Slots.size() == 102);
+			Assert::IsTrue(a->Get("p99") == Variant{ 99 });
+			Assert::IsTrue(RunScript(R"a(
+let sum = 0;
+for(i = 0;i<100;i++) {
+	let o = object();
+	o.a = i;
+	o.b = o.a * 2;
+	sum = sum + o.b - o.a;
+}
+return sum;
+)a") == Variant{ 4950 });
+		}
+		TEST_METHOD(PropertyCacheTest) {
+			const char* script = R"a(
+var make = function(i, k){
+	let o = object();
+	if(k == 1)
+		o.pad = 0;
+	if(k == 2) {
+		o.x = 0;
+		o.pad = 0;
+	}
+	o.x = i;
+	o.y = i * 2;
+	return o;
+};
+let sum = 0;
+for(i = 0;i<300;i++) {
+	let o = make(i, i / 100);
+	sum = sum + o.y - o.x;
+	if(o.z != null)
+		sum = 0;
+}
+return sum;
+)a";
+			auto em = Compile(script);
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			Assert::IsTrue(ir.Run(ctx) == Variant{ 44850 });
+			auto& st = ir.GetCacheStats();
+			// 三种形状都在缓存容量之内，只有第一次见到某种形状时才会未命中
+			Assert::IsTrue(st.PropertyHits > 1500 && st.PropertyMisses < 30 && st.MegamorphicSites == 0);
+		}
+		TEST_METHOD(GlobalSlotTest) {
+			const char* script = R"a(
+var total = 0;
+var step = 3;
+for(i = 0;i<1000;i++) {
+	total = total + step;
+	true = 0;
+}
+return total;
+)a";
+			auto em = Compile(script);
+			// 全局变量在发射时已经分配槽位，不再按名称查找
+			for (auto& s : em.Strings)
+				Assert::IsTrue(s != "total" && s != "step");
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			Assert::IsTrue(ir.Run(ctx) == Variant{ 3000 });
+			Assert::IsTrue(ctx.LookupGlobal("total") == Variant{ 3000 });
+			// 常量不能被覆盖
+			Assert::IsTrue(ctx.LookupGlobal("true") == Variant{ 1 });
+		}
+		TEST_METHOD(NativeCallTest) {
+			ctx.NativeFunctions["sum2"] = { [](ScriptContext& ctx, NativeArgs vars) -> Variant {
+				return vars[0] + vars[1];
+			}, 2, 2, "Usage: sum2(a,b)" };
+			Assert::IsTrue(RunScript(R"a(
+let s = 0;
+for(i = 0;i<100;i++)
+	s = sum2(s, abs(0 - i));
+return s;
+)a") == Variant{ 4950 });
+			// 参数个数在调用前检查
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("return sum2(1);");
+			});
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("return sqrt(1, 2);");
+			});
+		}
+		TEST_METHOD(BindTest) {
+			ctx.Bind<[](double x, int n) { return x * n; }>("scale");
+			ctx.Bind<[](double x) { return 1 < x; }>("gt1");
+			Assert::IsTrue(RunScript("return scale(1.5, 4);") == Variant{ 6.0 });
+			Assert::IsTrue(RunScript("return gt1(2);") == Variant{ 1 });
+			Assert::IsTrue(RunScript("return sqrt(16) + abs(0 - 3);") == Variant{ 7.0 });
+			// abs 保持整数类型
+			Assert::IsTrue(RunScript("return abs(0 - 3);").Type == Variant::DataType::Int);
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("return scale(1);");
+			});
+			// 名称已经有槽位时，注册的函数也要写入槽位
+			RunScript("var twice = 0; var half = 0;");
+			ctx.Bind<[](int x) { return x * 2; }>("twice");
+			ctx.AddFunction("half", [](ScriptContext& ctx, std::vector<Variant>& vars) -> Variant {
+				return script_cast<int>(vars[0]) / 2;
+			});
+			Assert::IsTrue(RunScript("return twice(21) + half(10);") == Variant{ 47 });
+		}
+		TEST_METHOD(VectorBuiltinsTest) {
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+let b = array();
+for(i = 0;i<1001;i++) {
+	a[i] = i;
+	b[i] = 2;
+}
+return array_sum(a) + array_dot(a, b);
+)a") == Variant{ 1501500 });
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+a[0] = 4.0;
+a[1] = 9;
+a[2] = 0 - 16;
+let r = map_sqrt(map_abs(a));
+return array_sum(r);
+)a") == Variant{ 9.0 });
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("let a = array(); a[0] = \"x\"; return array_sum(a);");
+			});
+			// 与 abs 一致，Int 数组的结果仍是 Int
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+a[0] = 0 - 3;
+a[1] = 4;
+return map_abs(a)[0];
+)a").Type == Variant::DataType::Int);
+			// 数值数组直接参与计算，整数与浮点数组可以混合
+			Assert::IsTrue(RunScript(R"a(
+let f = float64array(100);
+let n = int64array(100);
+let m = int32array(100);
+for(i = 0;i<100;i++) {
+	f[i] = 0.5;
+	n[i] = i;
+	m[i] = 2;
+}
+return array_dot(f, n) + array_dot(n, m) + array_sum(n);
+)a") == Variant{ 2475.0 + 9900 + 4950 });
+			// 超过 MaxRetained 的数组，调用结束后释放缓冲区
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+for(i = 0;i<200000;i++)
+	a[i] = i;
+return array_sum(map_abs(a));
+)a") == Variant{ 19999900000ll });
+		}
+		TEST_METHOD(TypedArrayTest) {
+			Assert::IsTrue(RunScript(R"a(
+let f = float64array(1000);
+let n = int32array(1000);
+for(i = 0;i<1000;i++) {
+	f[i] = i * 0.5;
+	n[i] = i + 0.75;
+}
+let last = n[999];
+return array_sum(f) + array_sum(n) + last;
+)a") == Variant{ 249750.0 + 499500.0 + 999 });
+			Assert::ExpectException<std::runtime_error>([&]() {
+				RunScript("let a = int64array(4); return a[4];");
+			});
+		}
+		TEST_METHOD(ArrayIndexTest) {
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+for(i = 0;i<1000;i++)
+	a[i] = i;
+let s = 0;
+for(i = 0;i<1000;i++) {
+	let x = a[i];
+	s = s + x;
+}
+if(a[5000] != null)
+	return 0 - 1;
+return s;
+)a") == Variant{ 499500 });
+			auto em = Compile("let a = array(); a[3] = 1; let b = a[100]; return a;");
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			auto a = ir.Run(ctx);
+			// 越界读取不改变数组
+			Assert::IsTrue(((ScriptArray*)a.Object)->Size() == 4);
+			Assert::ExpectException<std::runtime_error>([&]() {
+				RunScript("let o = object(); return o[0];");
+			});
+		}
+		TEST_METHOD(RangeTest) {
+			Assert::IsTrue(RunScript(R"a(
+let s = 0;
+let n = 10;
+foreach(i : 0..n+1) {
+	if(i == 3)
+		continue;
+	s = s + i;
+}
+foreach(j : 5..0)
+	s = s + j;
+return s;
+)a") == Variant{ 52 + 10 });
+			// foreach 直接计数时也要求两端是整数
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("let s = 0; foreach(x : 0.5..3) s = s + x; return s;");
+			});
+			Assert::ExpectException<std::exception>([&]() {
+				RunScript("let s = 0; let b = 2.5; foreach(x : 0..b) s = s + x; return s;");
+			});
+			// 区间不生成元素
+			Assert::IsTrue(RunScript(R"a(
+let r = 0..1000000000;
+let last = r[999999999];
+return last;
+)a") == Variant{ 999999999 });
+		}
+		TEST_METHOD(ForeachTest) {
+			Assert::IsTrue(RunScript(R"a(
+let a = array();
+a[0] = 1; a[1] = 2; a[2] = 3; a[3] = 4;
+let s = 0;
+foreach(x : a) {
+	if(x == 4)
+		break;
+	s = s + x;
+}
+let r = 10..12;
+foreach(x : r)
+	s = s + x;
+let t = int32array(a);
+foreach(x : t)
+	s = s + x;
+return s;
+)a") == Variant{ 6 + 21 + 10 });
+			// 对象遍历属性名
+			Assert::IsTrue(RunScript(R"a(
+let o = object();
+o.foo = 1;
+o.bar = 2;
+let s = 0;
+foreach(k : o) {
+	if(k == "bar")
+		s = s + 10;
+	s = s + 1;
+}
+return s;
+)a") == Variant{ 12 });
+		}
+		TEST_METHOD(StringPoolTest) {
+			// 大量函数重复使用同一批成员名，常量池中每个名字只出现一次
+			std::string script = "var o = object();\nvar s = 0;\n";
+			for (int i = 0; i < 2000; i++) {
+				auto name = "m" + std::to_string(i / 100);
+				script += "var f" + std::to_string(i) + " = function(x){ o." + name + " = x; return o." + name + "; };\n";
+				script += "s = s + f" + std::to_string(i) + "(1);\n";
+			}
+			script += "return s;\n";
+			auto em = Compile(script);
+			Assert::IsTrue(em.Strings.size() == 20 && em.StringIndex.size() == 20);
+			ir::Interpreter ir(em.Bytes, em.Strings);
+			Assert::IsTrue(ir.Run(ctx) == Variant{ 2000 });
+		}
+		TEST_METHOD(ScopeTest) {
+			// 块中的 let 遮蔽外层的同名变量
+			Assert::IsTrue(RunScript(R"a(
+let x = 1;
+let s = 0;
+if(x == 1) {
+	let x = x + 10;
+	s = s + x;
+}
+s = s + x;
+return s;
+)a") == Variant{ 12 });
+			// 本地变量超过 255 个
+			std::string body;
+			for (int i = 0; i < 300; i++)
+				body += "let v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+			body += "let s = v0 + v299;\ns = s + v150;\nreturn s;\n";
+			Assert::IsTrue(RunScript(body) == Variant{ 449 });
+			Assert::IsTrue(RunScript("var f = function(){\n" + body + "};\nreturn f();\n") == Variant{ 449 });
+		}
+		TEST_METHOD(BytecodeFileTest) {
+			std::string script = R"a(var base = 5; var tag = "t";
+var f = function(n){
+	return n * 2;
+};
+let s = abs(0 - base); let k = 0; while(k < 2) k++;
+s = s + f(10);
+return s;
+)a";
+			// 与这段代码无关的全局变量不写入文件
+			ctx.GlobalSlot("unrelated_a");
+			ctx.GlobalSlot("unrelated_b");
+			auto em = Compile(script, true);
+			auto file = ir::SaveBytecode(em);
+
+			// 在另一个上下文中载入，全局变量的槽位与编译时不同
+			ScriptContext ctx2;
+			LoadBasic(ctx2);
+			LoadCMath(ctx2);
+			ctx2.GlobalSlot("unrelated");
+			auto mod = ir::LoadBytecode(file);
+			mod.BindGlobals(ctx2);
+			Assert::IsTrue(mod.Functions.size() == 1 && mod.Lines.size() == em.Lines.size());
+			// base、tag、f 与 abs
+			Assert::IsTrue(mod.GlobalNames.size() == 4);
+			Assert::IsTrue(std::find(mod.GlobalNames.begin(), mod.GlobalNames.end(), "unrelated_a") == mod.GlobalNames.end());
+			Assert::IsTrue(ir::LineAt(mod.Lines, mod.Functions[0]) == 2);
+			Assert::IsTrue(ir::LineAt(mod.Lines, mod.Code.size() - 1) == 7);
+			ir::Interpreter ir(mod.Code, mod.Strings);
+			Assert::IsTrue(ir.Run(ctx2) == Variant{ 25 });
+			Assert::IsTrue(ctx2.LookupGlobal("base") == Variant{ 5 });
+
+			auto rejected = [](const std::vector<char>& data) {
+				try {
+					ir::LoadBytecode(data);
+				}
+				catch (std::runtime_error&) {
+					return true;
+				}
+				return false;
+			};
+			// 版本不同的文件被拒绝
+			auto bad = file;
+			bad[4]++;
+			Assert::IsTrue(rejected(bad));
+
+			// 代码节位于文件头(12 字节)与节头(8 字节)之后，布局与 em.Bytes 相同
+			const size_t code = 20;
+			auto patch = [&](std::initializer_list<ir::Opcode> ops, size_t offset, auto value) {
+				auto data = file;
+				for (size_t pc = 0; pc < em.Bytes.size(); pc += 1 + ir::GetOperandSize((ir::Opcode)em.Bytes[pc])) {
+					if (std::find(ops.begin(), ops.end(), (ir::Opcode)em.Bytes[pc]) != ops.end()) {
+						memcpy(&data[code + pc + 1 + offset], &value, sizeof(value));
+						return data;
+					}
+				}
+				Assert::IsTrue(false);
+				return data;
+			};
+			Assert::IsTrue(!rejected(file));
+			// 数量超过节中剩余的字节
+			bad = file;
+			auto count = (uint32_t)0x7fffffff;
+			memcpy(&bad[code + em.Bytes.size() + 8], &count, sizeof(count));
+			Assert::IsTrue(rejected(bad));
+			// 字符串下标越界
+			Assert::IsTrue(rejected(patch({ ir::OP_PushStr, ir::OP_PushGlobalVar, ir::OP_GetProp }, 0, (uint32_t)1000)));
+			// 跳转目标不在指令边界上
+			Assert::IsTrue(rejected(patch({ ir::OP_Jmp }, 0, (int32_t)(ir::GetOperandSize(ir::OP_PushNI4) + 2))));
+			// 函数地址不是函数入口
+			Assert::IsTrue(rejected(patch({ ir::OP_PushFuncPtr }, 0, (uint32_t)1)));
+			// 本地变量超出栈帧
+			Assert::IsTrue(rejected(patch({ ir::OP_PushLocalI1, ir::OP_StoreLocalI1, ir::OP_RMov, ir::OP_RLoadI, ir::OP_RAddI }, 0, (unsigned char)100)));
+			// 寄存器比较的条件不是比较指令
+			Assert::IsTrue(rejected(patch({ ir::OP_RCmpJnz, ir::OP_RCmpIJnz }, 0, (unsigned char)ir::OP_Add)));
+			// 弹出栈帧以下的值：把函数中的 PushI4 换成同样长度的 Popn 255; Popn 255; Ret
+			bad = file;
+			for (size_t pc = mod.Functions[0]; pc < em.Bytes.size(); pc += 1 + ir::GetOperandSize((ir::Opcode)em.Bytes[pc])) {
+				if (em.Bytes[pc] == ir::OP_PushI4) {
+					const unsigned char underflow[] = { ir::OP_Popn, 255, ir::OP_Popn, 255, ir::OP_Ret };
+					memcpy(&bad[code + pc], underflow, sizeof(underflow));
+					break;
+				}
+			}
+			Assert::IsTrue(bad != file);
+			Assert::IsTrue(rejected(bad));
+		}
+		TEST_METHOD(SharedCodeTest) {
+			std::string script = R"a(var n = 0;
+for(i = 0;i<1000;i++)
+	n = n + i;
+return n;
+)a";
+			auto em = Compile(script, true);
+			ir::SaveBytecodeFile(em, "nztest_shared.nzc");
+			{
+				ir::MappedFile file("nztest_shared.nzc");
+				auto data = file.Data();
+				auto image = std::vector<char>(data.begin(), data.end());
+				// 多个上下文共享映射的代码，槽位一致时不复制
+				for (int i = 0; i < 3; i++) {
+					ScriptContext ctx2;
+					LoadBasic(ctx2);
+					auto mod = ir::LoadBytecode(data);
+					mod.BindGlobals(ctx2);
+					Assert::IsTrue(mod.Bytes.empty() && mod.Code.data() >= data.data() && mod.Code.data() < data.data() + data.size());
+					ir::Interpreter ir(mod.Code, mod.Strings);
+					Assert::IsTrue(ir.ReadOnly);
+					Assert::IsTrue(ir.Run(ctx2) == Variant{ 499500 });
+				}
+				// 只读的代码没有被特化改写
+				Assert::IsTrue(std::equal(data.begin(), data.end(), image.begin(), image.end()));
+			}
+			std::remove("nztest_shared.nzc");
+		}
+		TEST_METHOD(ArenaReuseTest) {
+			GC gc;
+			auto fill = [&]() {
+				for (int i = 0; i < 5000; i++) {
+					new (gc) ScriptObject(gc);
+					new (gc) ScriptArray(gc);
+					Variant s{ gc, "arena" };
+				}
+			};
+			fill();
+			gc.Collect(true);
+			auto chunks = gc.ChunkCount();
+			Assert::IsTrue(gc.ObjectCount() == 0 && chunks > 0);
+			// 释放的单元被复用，不再申请新的区块
+			fill();
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 0 && gc.ChunkCount() == chunks);
+		}
+		TEST_METHOD(ConstructorThrowTest) {
+			// 超过 MaxSmall 的对象走全局 new
+			struct Large : GCObject {
+				char Payload[GCArena::MaxSmall * 2];
+				Large(GC& gc) : GCObject(gc, sizeof(Large)) {
+					throw std::runtime_error("Large");
+				}
+			};
+			GC gc;
+			auto keep = new (gc) ScriptObject(gc);
+			auto bytes = gc.HeapBytes();
+			// 构造函数抛出异常后对象不能留在 GC 中，否则回收时会再次释放
+			Assert::ExpectException<std::length_error>([&]() { new (gc) Int64Array(gc, (size_t)1 << 62); });
+			Assert::ExpectException<std::runtime_error>([&]() { new (gc) Large(gc); });
+			Assert::IsTrue(gc.ObjectCount() == 1 && gc.HeapBytes() == bytes);
+			gc.AddRoot(keep);
+			gc.Collect(true);
+			Assert::IsTrue(gc.ObjectCount() == 1);
+			gc.RemoveRoot(keep);
+		}
+		TEST_METHOD(StackRootTest) {
+			// 只在栈上(本地变量、参数、临时值)的对象在运行中回收后仍然有效
+			Assert::IsTrue(RunScript(R"a(
+var make = function(n){
+	let o = object();
+	o.v = n;
+	collect();
+	o.s = "v" + n;
+	return o;
+};
+var keep = function(o, n){
+	collect(n > 25);
+	return o.v + n;
+};
+let sum = 0;
+for(i = 0;i<50;i++) {
+	let a = make(i);
+	sum = sum + keep(make(i), i) + a.v;
+}
+return sum;
+)a") == Variant{ 3675 });
+		}
+		TEST_METHOD(HeapBudgetTest) {
+			ctx.ConfigureHeap(64 << 10);
+			Assert::IsTrue(RunScript(R"a(
+keep = array();
+for(i = 0;i<20000;i++) {
+	let o = object();
+	o.v = i;
+	if(i < 100)
+		keep[i] = o;
+}
+s = gcstats();
+let sum = 0;
+for(i = 0;i<100;i++) {
+	let o = keep[i];
+	sum = sum + o.v;
+}
+return s.minor + s.major > 0 && s.bytes < s.budget && sum == 4950;
+)a") == Variant{ 1 });
+			// 存活对象超过上限时脚本抛出异常
+			ctx.ConfigureHeap(64 << 10, 2.0, 256 << 10);
+			Assert::ExpectException<std::runtime_error>([&]() {
+				RunScript(R"a(
+keep = array();
+for(i = 0;i<20000;i++)
+	keep[i] = object();
+)a"); });
+		}
+		TEST_METHOD(HeapGrowthLimitTest) {
+			// 只有一个数组对象，增长的元素空间也要计入堆预算
+			ctx.ConfigureHeap(64 << 10, 2.0, 1 << 20);
+			Assert::ExpectException<std::runtime_error>([&]() {
+				RunScript(R"a(
+big = array();
+for(i = 0;i<3000000;i++)
+	big[i] = i;
+)a"); });
+			RunScript("big = null; collect(true);");
+			auto bytes = ctx.gc.HeapBytes();
+			Assert::IsTrue(RunScript(R"a(
+small = array();
+for(i = 0;i<1000;i++)
+	small[i] = i;
+return small[999];
+)a") == Variant{ 999 });
+			Assert::IsTrue(ctx.gc.HeapBytes() >= bytes + 1000 * sizeof(VariantSlot));
+		}
+		TEST_METHOD(DeepGraphCollectTest) {
+			Assert::IsTrue(RunScript(R"a(
+head = null;
+for(i = 0;i<200000;i++) {
+	n = object();
+	n.next = head;
+	head = n;
+}
+collect();
+head = null;
+n = null;
+collect();
+s = gcstats();
+return s.major >= 2 && s.freed >= 200000;
+)a") == Variant{ 1 });
+		}
+		TEST_METHOD(PackedValueTest) {
+			Variant fn{};
+			fn.Type = Variant::DataType::FuncPC;
+			fn.Pointer = 42;
+			std::vector<Variant> values = {
+				Variant{},
+				Variant{ -7 },
+				Variant{ -(1ll << 47) },
+				Variant{ 1ll << 60 },
+				Variant{ 1.5f },
+				Variant{ -0.25 },
+				Variant{ std::numeric_limits<double>::infinity() },
+				Variant{ ctx.gc, "str" },
+				fn,
+			};
+			// 直接检查编码，不依赖 NZ_NAN_BOXING 是否打开
+			for (auto& value : values) {
+				PackedVariant packed = value;
+				PackedVariant moved = std::move(packed);
+				PackedVariant copied;
+				copied = moved;
+				Variant v = copied;
+				Assert::IsTrue(v.Type == value.Type);
+				if (v.Type != Variant::DataType::Null)
+					Assert::IsTrue(v == value);
+				Assert::IsTrue(((Variant)packed).Type == Variant::DataType::Null);
+			}
+			Variant boxed = PackedVariant{ Variant{ 1ll << 60 } };
+			Assert::IsTrue(boxed.Type == Variant::DataType::Long && boxed.Long == 1ll << 60);
+			auto arr = new (ctx.gc) ScriptArray(ctx.gc);
+			for (size_t i = 0; i < values.size(); i++)
+				arr->Set(i, values[i]);
+			arr->Add(std::numeric_limits<double>::quiet_NaN());
+			auto copy = arr->Variants;
+			for (size_t i = 0; i < values.size(); i++) {
+				Variant v = copy[i];
+				Assert::IsTrue(v.Type == values[i].Type);
+				if (v.Type != Variant::DataType::Null)
+					Assert::IsTrue(v == values[i]);
+			}
+			Variant nan = copy.back();
+			Assert::IsTrue(nan.Type == Variant::DataType::Double && std::isnan(nan.Double));
+			Variant packedNaN = PackedVariant{ Variant{ -std::numeric_limits<double>::quiet_NaN() } };
+			Assert::IsTrue(packedNaN.Type == Variant::DataType::Double && std::isnan(packedNaN.Double));
+		}
 	};
-}
\ No newline at end of file
+}